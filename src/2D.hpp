@@ -2,6 +2,7 @@
 #define TWOD_H_
 
 #include <cctype>
+#include <cmath>
 #include <limits>
 #include <iostream>
 #include <sstream>
@@ -17,6 +18,8 @@ using std::ostream;
 
 typedef double coord;
 typedef uint64_t dim;
+// micrometres. the interpreter, the plotter and the canvas work in this fixed point format.
+typedef int32_t icoord;
 
 class Point {
 public:
@@ -51,6 +54,35 @@ public:
   }
 };
 
+// a point in micrometres
+class IPoint {
+public:
+  icoord x;
+  icoord y;
+
+  IPoint(icoord x, icoord y): x(x), y(y) {}
+  IPoint(): x(0), y(0) {}
+  explicit IPoint(const Point& mm): x(icoord(std::lround(mm.x * 1000))), y(icoord(std::lround(mm.y * 1000))) {}
+
+  bool operator==(const IPoint &p) const {
+    return this->x == p.x && this->y == p.y;
+  }
+
+  bool operator!=(const IPoint &p) const {
+    return !(this->operator==(p));
+  }
+
+  // in millimetres
+  Point toPoint() const {
+    return Point(x / 1000.0, y / 1000.0);
+  }
+
+  friend ostream& operator <<(ostream &os, const IPoint &p) {
+    os << p.toPoint();
+    return os;
+  }
+};
+
 class BoundingBox {
 public:
   Point ul;
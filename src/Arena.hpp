@@ -0,0 +1,115 @@
+#ifndef SRC_ARENA_HPP_
+#define SRC_ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/*
+ * A bump allocator. Memory is carved out of big blocks and released all at once
+ * by reset() or when the arena is destroyed. Single threaded.
+ */
+class Arena {
+private:
+	static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+	struct Block {
+		Block* next;
+		size_t size;
+	};
+
+	Block* blocks_;
+	char* cur_;
+	char* end_;
+
+	void grow(size_t size, size_t align) {
+		size_t blockSize = sizeof(Block) + size + align;
+		if (blockSize < BLOCK_SIZE)
+			blockSize = BLOCK_SIZE;
+		Block* block = static_cast<Block*>(malloc(blockSize));
+		if (block == NULL)
+			throw std::bad_alloc();
+		block->next = blocks_;
+		block->size = blockSize;
+		blocks_ = block;
+		cur_ = reinterpret_cast<char*>(block + 1);
+		end_ = reinterpret_cast<char*>(block) + blockSize;
+	}
+
+	void freeBlocks(Block* block) {
+		while (block != NULL) {
+			Block* next = block->next;
+			free(block);
+			block = next;
+		}
+	}
+
+public:
+	Arena() :
+			blocks_(NULL), cur_(NULL), end_(NULL) {
+	}
+
+	virtual ~Arena() {
+		freeBlocks(blocks_);
+	}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t align) {
+		uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+		if (cur_ == NULL || p + size > reinterpret_cast<uintptr_t>(end_)) {
+			grow(size, align);
+			p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+		}
+		cur_ = reinterpret_cast<char*>(p + size);
+		return reinterpret_cast<void*>(p);
+	}
+
+	// releases everything allocated so far. the newest block is kept for reuse.
+	void reset() {
+		if (blocks_ == NULL)
+			return;
+		freeBlocks(blocks_->next);
+		blocks_->next = NULL;
+		cur_ = reinterpret_cast<char*>(blocks_ + 1);
+		end_ = reinterpret_cast<char*>(blocks_) + blocks_->size;
+	}
+};
+
+// lets standard containers allocate from an arena. deallocation is a no-op.
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	Arena* arena;
+
+	ArenaAllocator(Arena& arena) :
+			arena(&arena) {
+	}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) :
+			arena(other.arena) {
+	}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n) {
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {
+		return arena == other.arena;
+	}
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const {
+		return arena != other.arena;
+	}
+};
+
+#endif /* SRC_ARENA_HPP_ */
@@ -6,7 +6,9 @@
 #include <stdlib.h>
 #include <iostream>
 #include <list>
+#ifdef PCLINT_USE_SDL
 #include <SDL/SDL.h>
+#endif
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -105,7 +107,9 @@ public:
           cerr << "=== auto update off" << endl;
         }
       } else if (cmd.compare("quit") == 0) {
+#ifdef PCLINT_USE_SDL
     	SDL_Quit();
+#endif
     	exit(0);
       } else {
     	  cerr << "Unknown rdint command. Type 'help' for instructions." << endl;
@@ -134,7 +138,7 @@ public:
     }
   }
 
-  void checkBreakpoints(RdInstr *instr) {
+  void checkBreakpoints(const RdInstr *instr) {
     if (breakpoints.size() > 0 && instr) {
       list<off64_t>::iterator it;
       off64_t bp = numeric_limits<off64_t>::max();
@@ -151,7 +155,7 @@ public:
     }
   }
 
-  void checkSignatures(RdInstr *instr) {
+  void checkSignatures(const RdInstr *instr) {
     if (find.length() > 0 && instr && instr->matches(find)) {
       cerr << "=== found " << find << endl;
       setInteractive(true);
@@ -190,7 +194,9 @@ public:
       } else
         exec(lastCliCmd[0], lastCliCmd[1]);
     }
+#ifdef PCLINT_USE_SDL
     SDL_Quit();
+#endif
     exit(0);
   }
 
@@ -214,7 +220,7 @@ public:
 	  run = false;
   }
 
-  virtual void announce(RdInstr* instr) {
+  virtual void announce(const RdInstr* instr) {
     checkStepBarrier();
     checkBreakpoints(instr);
     checkSignatures(instr);
@@ -1,4 +1,13 @@
+#include <cassert>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include "Canvas.hpp"
+#include "Config.hpp"
+#include "Trace.hpp"
 #ifdef PCLINT_USE_SDL
 #include <SDL/SDL.h>
 #include <SDL/SDL_gfxPrimitives.h>
@@ -6,24 +15,32 @@
 #endif
 
 Canvas::Canvas(dim bedWidth, dim bedHeight, dim screenWidth, dim screenHeight,
-    BoundingBox* clip) :
+    BoundingBox* clip, const BoundingBox* region) :
   screen(NULL), bedWidth(bedWidth), bedHeight(bedHeight),
       screenWidth(screenWidth), screenHeight(screenHeight), clip(clip),
-      offscreen(bedWidth, bedHeight, 1, 1, 255), scale(1) {
-#ifdef PCLINT_USE_SDL
-  if (screenWidth > 0 && screenHeight > 0) {
-    if (SDL_Init(SDL_INIT_VIDEO) == -1) {
-      printf("Can't init SDL:  %s\n", SDL_GetError());
-      exit(1);
-    }
-    atexit(SDL_Quit);
-    screen = SDL_SetVideoMode(screenWidth, screenHeight, 16, SDL_SWSURFACE);
-    if (screen == NULL) {
-      printf("Can't set video mode: %s\n", SDL_GetError());
-      exit(1);
-    }
+      originX(0), originY(0), width(bedWidth), height(bedHeight), scale(1),
+      pool(Config::singleton()->jobs > 1 ? new ThreadPool(Config::singleton()->jobs) : NULL),
+      tilesX(0), tilesY(0), pending(), bins(), binBase(0), binned(0), flushBytes(0), tiles(),
+      bandRows(0), bands(), bandFd(-1), bandFileSize(0), bandFailed(false), bandChunk(BAND_CHUNK),
+      bandStore(NULL), bandStoreBytes(0), error(), presenter(), presenting(false),
+      recordMutex(), recorded() {
+  if (region != NULL) {
+    // nothing is drawn outside of the bed
+    IPoint ul(region->ul);
+    IPoint lr(region->lr);
+    originX = std::max(0, toPixel(ul.x));
+    originY = std::max(0, toPixel(ul.y));
+    width = std::max(0, std::min(int(bedWidth) - 1, toPixel(lr.x)) + 1 - originX);
+    height = std::max(0, std::min(int(bedHeight) - 1, toPixel(lr.y)) + 1 - originY);
   }
-#endif
+  tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  tiles.resize(size_t(tilesX) * tilesY, NULL);
+  size_t imageBudget = Config::singleton()->imageBudget();
+  if (imageBudget > 0 && width > 0 && height > 0 && !initBands(imageBudget))
+    return;
+  if (pool != NULL && bandRows == 0)
+    bins.resize(size_t(tilesX) * tilesY);
   if (clip != NULL) {
     bedWidth = clip->min(bedWidth, clip->lr.x - clip->ul.x);
     bedWidth = clip->min(bedWidth, clip->lr.y - clip->ul.y);
@@ -34,69 +51,601 @@ Canvas::Canvas(dim bedWidth, dim bedHeight, dim screenWidth, dim screenHeight,
   double scale_y = (double) screenHeight / (double) (bedHeight / 10);
 
   scale = std::min(scale_x, scale_y);
-}
 
-void checkExit() {
 #ifdef PCLINT_USE_SDL
-  SDL_Event event;
-  if(SDL_PollEvent(&event) && event.type == SDL_QUIT) {
-    exit(0);
+  if (screenWidth > 0 && screenHeight > 0) {
+    presenting = true;
+    presenter = std::thread([this] { present(); });
   }
 #endif
 }
 
-void Canvas::drawPixel(coord x0, coord y0, uint8_t r,uint8_t g,uint8_t b) {
+bool Canvas::initBands(size_t budget) {
+  // the tile pointers and the buckets come off first
+  size_t tileRowBytes = size_t(tilesX) * TILE_BYTES;
+  size_t fixed = tiles.size() * sizeof(uint64_t*) + size_t(tilesY) * sizeof(BandBucket);
+  size_t rows = fixed < budget ? std::min<size_t>((budget - fixed) / 2 / tileRowBytes, tilesY) : 0;
+  if (rows == 0) {
+    error = "The memory budget leaves " + std::to_string(budget)
+        + " bytes for the image, a band of it needs " + std::to_string(fixed + 2 * tileRowBytes);
+    return false;
+  }
+  budget -= fixed;
+  bandRows = int(rows) * TILE_SIZE;
+  bands.resize((height + bandRows - 1) / bandRows);
+  bandChunk = std::min(BAND_CHUNK, budget / 4 / (bands.size() * sizeof(PixelSegment)));
+  if (bandChunk < MIN_BAND_CHUNK) {
+    error = "The memory budget is too small for the buffers of " + std::to_string(bands.size())
+        + " bands";
+    return false;
+  }
+  // pending and the bins take up to twice what they hold
+  flushBytes = budget / 8;
+  if (pool != NULL)
+    bins.resize(rows * tilesX);
+
+  FILE* file = tmpfile();
+  if (file == NULL || (bandFd = dup(fileno(file))) < 0) {
+    error = "Can't create a temporary file for the bands";
+    if (file != NULL)
+      fclose(file);
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+/*
+ * CImg::draw_line() on a width x height image, limited to the pixels in
+ * [clipX0, clipX1) x [clipY0, clipY1). plot(x, y) sets a pixel, span(x0, x1, y) the pixels
+ * [x0, x1] of a row. Every pixel is computed by the same formula as in draw_line(), so drawing
+ * a line clip by clip gives the same image as drawing it at once. draw_line() itself can't be
+ * used from several threads, its line pattern state is static.
+ */
+template<typename Plot, typename Span>
+static void rasterLine(int width, int height, int x0, int y0, int x1, int y1,
+    int clipX0, int clipY0, int clipX1, int clipY1, Plot plot, Span span) {
+  if (std::min(y0, y1) >= height || std::max(y0, y1) < 0
+      || std::min(x0, x1) >= width || std::max(x0, x1) < 0)
+    return;
+
+  // axis aligned lines are filled as a span or a column, no stepping needed
+  if (y0 == y1 || x0 == x1) {
+    int minX = std::max(std::max(std::min(x0, x1), 0), clipX0);
+    int maxX = std::min(std::min(std::max(x0, x1), width - 1), clipX1 - 1);
+    int minY = std::max(std::max(std::min(y0, y1), 0), clipY0);
+    int maxY = std::min(std::min(std::max(y0, y1), height - 1), clipY1 - 1);
+    if (minY == maxY) {
+      if (minX <= maxX)
+        span(minX, maxX, minY);
+    } else if (minX == maxX) {
+      for (int y = minY; y <= maxY; ++y)
+        plot(minX, y);
+    }
+    return;
+  }
+
+  int w1 = width - 1, h1 = height - 1;
+  int dx01 = x1 - x0, dy01 = y1 - y0;
+
+  // iterate along the major axis, called y from here on
+  const bool isHorizontal = cimg_library::cimg::abs(dx01) > cimg_library::cimg::abs(dy01);
+  if (isHorizontal) {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+    std::swap(w1, h1);
+    std::swap(dx01, dy01);
+    std::swap(clipX0, clipY0);
+    std::swap(clipX1, clipY1);
+  }
+  if (y0 > y1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+    dx01 *= -1;
+    dy01 *= -1;
+  }
+
+  const int hdy01 = dy01 * cimg_library::cimg::sign(dx01) / 2;
+  int cy0 = std::max(cimg_library::cimg::cut(y0, 0, h1), clipY0);
+  int cy1 = std::min(cimg_library::cimg::cut(y1, 0, h1) + 1, clipY1);
+  const int minX = std::max(0, clipX0), maxX = std::min(w1, clipX1 - 1);
+  dy01 += dy01 ? 0 : 1;
+
+  // only the steps where the line crosses the clip in the minor direction are taken. a step is
+  // less than 1.5 pixels off the exact line, a margin of 2 keeps every pixel of it.
+  double ya = y0 + double(minX - 2 - x0) * dy01 / dx01;
+  double yb = y0 + double(maxX + 2 - x0) * dy01 / dx01;
+  if (ya > yb)
+    std::swap(ya, yb);
+  if (ya > cy0)
+    cy0 = int(std::min(std::floor(ya), double(cy1)));
+  if (yb + 1 < cy1)
+    cy1 = int(std::max(std::ceil(yb) + 1, double(cy0)));
+
+  for (int y = cy0; y < cy1; ++y) {
+    const int x = x0 + (dx01 * (y - y0) + hdy01) / dy01;
+    if (x >= minX && x <= maxX) {
+      if (isHorizontal)
+        plot(y, x);
+      else
+        plot(x, y);
+    }
+  }
+}
+
+// the columns [minX, maxX] a line drawn by rasterLine() can set pixels of within the rows
+// [rowY0, rowY1], computed from the exact line with the same margin
+static void columnsInRows(int x0, int y0, int x1, int y1, int rowY0, int rowY1,
+    int& minX, int& maxX) {
+  minX = std::min(x0, x1);
+  maxX = std::max(x0, x1);
+  if (y0 == y1 || x0 == x1)
+    return;
+
+  if (y0 > y1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  double ya = std::max(double(y0), rowY0 - 2.0);
+  double yb = std::min(double(y1), rowY1 + 2.0);
+  double xa = x0 + double(x1 - x0) * (ya - y0) / (y1 - y0);
+  double xb = x0 + double(x1 - x0) * (yb - y0) / (y1 - y0);
+  if (xa > xb)
+    std::swap(xa, xb);
+  minX = std::max(minX, int(std::floor(xa)) - 2);
+  maxX = std::min(maxX, int(std::ceil(xb)) + 2);
+}
+
 #ifdef PCLINT_USE_SDL
-  checkExit();
-  if(screen != NULL) {
-    scaleCoordinate(x0);
-    scaleCoordinate(y0);
+/*
+ * The dirty cells of the window as rectangles: runs of cells in a row, merged with the run
+ * right above if it spans the same columns. More than MAX_DIRTY_RECTS become their union.
+ */
+static void dirtyRects(const std::vector<uint8_t>& dirty, int gridW, int gridH, int cellSize,
+    int screenW, int screenH, std::vector<SDL_Rect>& rects) {
+  static constexpr size_t MAX_DIRTY_RECTS = 32;
+  // the rects ending in the previous and in the current row of cells
+  std::vector<SDL_Rect> open, next;
+  rects.clear();
+  for (int gy = 0; gy < gridH; ++gy) {
+    next.clear();
+    for (int gx = 0; gx < gridW; ++gx) {
+      if (!dirty[size_t(gy) * gridW + gx])
+        continue;
+      int first = gx;
+      while (gx + 1 < gridW && dirty[size_t(gy) * gridW + gx + 1])
+        ++gx;
+      SDL_Rect r;
+      r.x = first * cellSize;
+      r.y = gy * cellSize;
+      r.w = std::min((gx + 1) * cellSize, screenW) - r.x;
+      r.h = std::min((gy + 1) * cellSize, screenH) - r.y;
 
-    pixelRGBA(screen, x0, y0, r, g, b, 128);
+      auto above = std::find_if(open.begin(), open.end(), [&](const SDL_Rect& o) {
+        return o.x == r.x && o.w == r.w;
+      });
+      if (above != open.end()) {
+        r.y = above->y;
+        r.h += above->h;
+        open.erase(above);
+      }
+      next.push_back(r);
+    }
+    rects.insert(rects.end(), open.begin(), open.end());
+    open.swap(next);
+  }
+  rects.insert(rects.end(), open.begin(), open.end());
+
+  if (rects.size() > MAX_DIRTY_RECTS) {
+    int x0 = screenW, y0 = screenH, x1 = 0, y1 = 0;
+    for (const SDL_Rect& r : rects) {
+      x0 = std::min(x0, int(r.x));
+      y0 = std::min(y0, int(r.y));
+      x1 = std::max(x1, r.x + r.w);
+      y1 = std::max(y1, r.y + r.h);
+    }
+    rects.resize(1);
+    rects[0].x = x0;
+    rects[0].y = y0;
+    rects[0].w = x1 - x0;
+    rects[0].h = y1 - y0;
   }
-#endif
 }
+#endif
 
-void Canvas::drawLine(coord x0, coord y0, coord x1, coord y1) {
+// SDL video may only be used from one thread, so the window is set up by the presenter
+void Canvas::present() {
 #ifdef PCLINT_USE_SDL
-  checkExit();
-  if(screen != NULL) {
-    scaleCoordinate(x0);
-    scaleCoordinate(y0);
-    scaleCoordinate(x1);
-    scaleCoordinate(y1);
-    lineRGBA(screen, x0, y0, x1, y1, 255, 255, 255, 128);
+  // without a window the job is still rendered to the image
+  if (SDL_Init(SDL_INIT_VIDEO) == -1) {
+    printf("Can't init SDL:  %s\n", SDL_GetError());
+    presenting = false;
+    return;
+  }
+  screen = SDL_SetVideoMode(screenWidth, screenHeight, 16, SDL_SWSURFACE);
+  if (screen == NULL) {
+    printf("Can't set video mode: %s\n", SDL_GetError());
+    presenting = false;
+    SDL_Quit();
+    return;
+  }
+
+  // the window is split into cells, a frame updates the cells drawn to since the last one
+  static constexpr int CELL_SIZE = 32;
+  int gridW = (screenWidth + CELL_SIZE - 1) / CELL_SIZE;
+  int gridH = (screenHeight + CELL_SIZE - 1) / CELL_SIZE;
+  std::vector<uint8_t> dirty(size_t(gridW) * gridH);
+  std::vector<SDL_Rect> rects;
+
+  std::vector<ScreenPrimitive> frame;
+  bool quit = false;
+  for (;;) {
+    // everything was recorded before presenting ends, it is shown with one last frame
+    bool last = !presenting;
+    Uint32 start = SDL_GetTicks();
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      // closing the window interrupts the run like ^C. main shuts down and joins this thread.
+      if (event.type == SDL_QUIT && !quit) {
+        quit = true;
+        raise(SIGINT);
+      }
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(recordMutex);
+      frame.swap(recorded);
+    }
+    if (!frame.empty()) {
+      std::fill(dirty.begin(), dirty.end(), 0);
+      for (const ScreenPrimitive& p : frame) {
+        if (p.isPixel)
+          pixelRGBA(screen, p.x0, p.y0, p.r, p.g, p.b, 128);
+        else
+          lineRGBA(screen, p.x0, p.y0, p.x1, p.y1, p.r, p.g, p.b, 128);
+
+        int cx0 = std::max(0, std::min(p.x0, p.x1) / CELL_SIZE);
+        int cy0 = std::max(0, std::min(p.y0, p.y1) / CELL_SIZE);
+        int cx1 = std::min(gridW - 1, std::max(p.x0, p.x1) / CELL_SIZE);
+        int cy1 = std::min(gridH - 1, std::max(p.y0, p.y1) / CELL_SIZE);
+        for (int cy = cy0; cy <= cy1 && cx0 <= cx1; ++cy) {
+          std::vector<uint8_t>::iterator row = dirty.begin() + size_t(cy) * gridW;
+          std::fill(row + cx0, row + cx1 + 1, 1);
+        }
+      }
+      dirtyRects(dirty, gridW, gridH, CELL_SIZE, screenWidth, screenHeight, rects);
+      if (!rects.empty())
+        SDL_UpdateRects(screen, rects.size(), rects.data());
+      frame.clear();
+    }
+    if (last)
+      break;
+
+    Uint32 elapsed = SDL_GetTicks() - start;
+    if (elapsed < 1000 / FRAME_RATE)
+      SDL_Delay(1000 / FRAME_RATE - elapsed);
   }
+  SDL_Quit();
 #endif
 }
 
-void Canvas::drawCut(coord x0, coord y0, coord x1, coord y1) {
-  offscreen.draw_line(x0 * 10, y0 * 10, x1 * 10, y1 * 10, this->intensity);
+void Canvas::record(const ScreenPrimitive& primitive) {
+  std::unique_lock<std::mutex> lock(recordMutex);
+  recorded.push_back(primitive);
+}
+
+void Canvas::drawPixel(icoord x0, icoord y0, uint8_t r,uint8_t g,uint8_t b) {
 #ifdef PCLINT_USE_SDL
-  checkExit();
-  if(screen != NULL) {
-    scaleCoordinate(x0);
-    scaleCoordinate(y0);
-    scaleCoordinate(x1);
-    scaleCoordinate(y1);
-    lineRGBA(screen, x0, y0, x1, y1, 255, 0, 0, 128);
-  }
+  if (!presenting)
+    return;
+  int16_t x = toScreen(x0), y = toScreen(y0);
+  record( { x, y, x, y, r, g, b, true });
 #endif
-  update();
 }
 
-void Canvas::update() {
+void Canvas::drawLine(icoord x0, icoord y0, icoord x1, icoord y1) {
 #ifdef PCLINT_USE_SDL
-  checkExit();
-  if(screen != NULL) {
-    SDL_Flip(screen);
+  if (presenting)
+    record( { int16_t(toScreen(x0)), int16_t(toScreen(y0)), int16_t(toScreen(x1)),
+        int16_t(toScreen(y1)), 255, 255, 255, false });
+#endif
+}
+
+uint64_t* Canvas::touchTile(size_t t) {
+  // in bands the tiles of the band are all there while it is rasterized
+  if (tiles[t] == NULL) {
+    assert(bandRows == 0);
+    tiles[t] = new uint64_t[TILE_SIZE * TILE_WORDS]();
+  }
+  return tiles[t];
+}
+
+void Canvas::binSegment(uint32_t i, int ty0, int ty1) {
+  const PixelSegment& seg = pending[i];
+  if (std::max(seg.x0, seg.x1) < 0 || std::max(seg.y0, seg.y1) < 0)
+    return;
+  ty0 = std::max(ty0, std::max(0, std::min(seg.y0, seg.y1)) / TILE_SIZE);
+  ty1 = std::min(ty1, std::max(seg.y0, seg.y1) / TILE_SIZE);
+  // in each row of tiles, only the ones the line passes
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    int x0, x1;
+    columnsInRows(seg.x0, seg.y0, seg.x1, seg.y1, ty * TILE_SIZE, (ty + 1) * TILE_SIZE - 1, x0, x1);
+    if (x1 < 0)
+      continue;
+    int tx1 = std::min(tilesX - 1, x1 / TILE_SIZE);
+    for (int tx = std::max(0, x0) / TILE_SIZE; tx <= tx1; ++tx)
+      bins[size_t(ty) * tilesX + tx - binBase].push_back(i);
+    binned += tx1 - std::max(0, x0) / TILE_SIZE + 1;
   }
+}
+
+void Canvas::binCut(const PixelSegment& seg) {
+  pending.push_back(seg);
+  binSegment(pending.size() - 1, 0, tilesY - 1);
+  if (pending.size() >= FLUSH_SEGMENTS)
+    flush();
+}
+
+void Canvas::bandCut(const PixelSegment& seg) {
+  int y0 = std::max(0, std::min(seg.y0, seg.y1));
+  int y1 = std::min(height - 1, std::max(seg.y0, seg.y1));
+  if (y0 > y1 || std::max(seg.x0, seg.x1) < 0 || std::min(seg.x0, seg.x1) >= width)
+    return;
+
+  for (int b = y0 / bandRows; b <= y1 / bandRows; ++b) {
+    BandBucket& bucket = bands[b];
+    if (bucket.buffer.empty())
+      bucket.buffer.reserve(bandChunk);
+    bucket.buffer.push_back(seg);
+    if (bucket.buffer.size() < bandChunk)
+      continue;
+
+    iovec chunk[2] = { { bucket.buffer.data(), bandChunk * sizeof(PixelSegment) },
+        { &bucket.last, sizeof(bucket.last) } };
+    ssize_t bytes = chunk[0].iov_len + chunk[1].iov_len;
+    if (pwritev(bandFd, chunk, 2, bandFileSize) != bytes)
+      bandFailed = true;
+    bucket.last = bandFileSize;
+    bandFileSize += bytes;
+    bucket.buffer.clear();
+  }
+}
+
+void Canvas::rasterizeBins() {
+  // the color is the same for all cuts, so the order they are drawn in doesn't matter.
+  // each task only touches its own tile.
+  pool->run(bins.size(), [&](size_t b) {
+    size_t t = binBase + b;
+    int clipX0 = (t % tilesX) * TILE_SIZE;
+    int clipY0 = (t / tilesX) * TILE_SIZE;
+    uint64_t* tile = NULL;
+    for (uint32_t i : bins[b]) {
+      const PixelSegment& seg = pending[i];
+      rasterLine(width, height, seg.x0, seg.y0, seg.x1, seg.y1,
+          clipX0, clipY0, clipX0 + TILE_SIZE, clipY0 + TILE_SIZE, [&](int x, int y) {
+        if (tile == NULL)
+          tile = touchTile(t);
+        setPixel(tile, x - clipX0, y - clipY0);
+      }, [&](int x0, int x1, int y) {
+        if (tile == NULL)
+          tile = touchTile(t);
+        setSpan(tile, x0 - clipX0, x1 - clipX0, y - clipY0);
+      });
+    }
+    // in bands the bins only grow as far as the budget allows once
+    if (bandRows > 0)
+      std::vector<uint32_t>().swap(bins[b]);
+    else
+      bins[b].clear();
+  });
+  binned = 0;
+}
+
+void Canvas::rasterizeCut(const PixelSegment& seg, int clipY0, int clipY1) {
+  rasterLine(width, height, seg.x0, seg.y0, seg.x1, seg.y1, 0, clipY0, width, clipY1,
+      [&](int x, int y) {
+    setPixel(touchTile(size_t(y / TILE_SIZE) * tilesX + x / TILE_SIZE),
+        x % TILE_SIZE, y % TILE_SIZE);
+  }, [&](int x0, int x1, int y) {
+    // one piece per tile
+    for (int x = x0; x <= x1; x = (x / TILE_SIZE + 1) * TILE_SIZE) {
+      setSpan(touchTile(size_t(y / TILE_SIZE) * tilesX + x / TILE_SIZE), x % TILE_SIZE,
+          std::min(x1, (x / TILE_SIZE + 1) * TILE_SIZE - 1) % TILE_SIZE, y % TILE_SIZE);
+    }
+  });
+}
+
+void Canvas::flush() {
+  // in bands the cuts wait until their band is written
+  if (pending.empty() || bandRows > 0)
+    return;
+
+  rasterizeBins();
+  pending.clear();
+}
+
+void Canvas::renderBand(int b) {
+  int clipY0 = b * bandRows;
+  int clipY1 = std::min(height, clipY0 + bandRows);
+  // the tiles of the band are an anonymous mapping: its pages are zero until drawn to,
+  // and go back to the system with the band
+  size_t begin = size_t(clipY0 / TILE_SIZE) * tilesX;
+  size_t end = std::min(tiles.size(), begin + size_t(bandRows) / TILE_SIZE * tilesX);
+  bandStoreBytes = (end - begin) * TILE_BYTES;
+  void* store = mmap(NULL, bandStoreBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (store == MAP_FAILED) {
+    bandFailed = true;
+    return;
+  }
+  bandStore = static_cast<uint64_t*>(store);
+  for (size_t t = begin; t < end; ++t)
+    tiles[t] = bandStore + (t - begin) * TILE_SIZE * TILE_WORDS;
+  binBase = begin;
+
+  // the chunks in the file from the last one written, then the rest in the buffer
+  BandBucket& bucket = bands[b];
+  std::vector<PixelSegment> chunk;
+  off_t next = bucket.last;
+  for (bool done = false; !done;) {
+    if (next >= 0) {
+      chunk.resize(bandChunk);
+      off_t at = next;
+      iovec parts[2] = { { chunk.data(), bandChunk * sizeof(PixelSegment) },
+          { &next, sizeof(next) } };
+      if (preadv(bandFd, parts, 2, at) != ssize_t(parts[0].iov_len + parts[1].iov_len)) {
+        bandFailed = true;
+        break;
+      }
+    } else {
+      chunk.swap(bucket.buffer);
+      done = true;
+    }
+
+    if (bins.empty()) {
+      for (const PixelSegment& seg : chunk)
+        rasterizeCut(seg, clipY0, clipY1);
+      continue;
+    }
+    for (const PixelSegment& seg : chunk) {
+      pending.push_back(seg);
+      binSegment(pending.size() - 1, clipY0 / TILE_SIZE, (clipY1 - 1) / TILE_SIZE);
+    }
+    if (pending.size() * sizeof(PixelSegment) + binned * sizeof(uint32_t) >= flushBytes || done) {
+      rasterizeBins();
+      pending.clear();
+    }
+  }
+  bucket = BandBucket();
+}
+
+void Canvas::releaseBand() {
+  if (bandStore == NULL)
+    return;
+  for (size_t t = binBase; t < binBase + bandStoreBytes / TILE_BYTES; ++t)
+    tiles[t] = NULL;
+  munmap(bandStore, bandStoreBytes);
+  bandStore = NULL;
+}
+
+void Canvas::drawCut(icoord x0, icoord y0, icoord x1, icoord y1) {
+  PixelSegment seg = { toPixel(x0) - originX, toPixel(y0) - originY,
+      toPixel(x1) - originX, toPixel(y1) - originY };
+  if (bandRows > 0)
+    bandCut(seg);
+  else if (bins.empty())
+    rasterizeCut(seg, 0, height);
+  else
+    binCut(seg);
+#ifdef PCLINT_USE_SDL
+  if (presenting)
+    record( { int16_t(toScreen(x0)), int16_t(toScreen(y0)), int16_t(toScreen(x1)),
+        int16_t(toScreen(y1)), 255, 0, 0, false });
 #endif
 }
 
+void Canvas::update() {
+}
+
+uint64_t Canvas::rowBits(int x, int y) const {
+  uint64_t bits = 0;
+  for (int i = 0; i < 64;) {
+    int px = x + i;
+    if (px < 0 || px >= int(bedWidth) || y < 0 || y >= int(bedHeight)) {
+      bits |= uint64_t(1) << i;
+      ++i;
+      continue;
+    }
+
+    int ix = px - originX, iy = y - originY;
+    if (ix < 0 || iy < 0 || ix >= width || iy >= height) {
+      ++i;
+      continue;
+    }
+    // the rest of the word the pixel is in. tiles start at a word.
+    int n = std::min(std::min(64 - ix % 64, 64 - i), width - ix);
+    const uint64_t* tile = tiles[size_t(iy / TILE_SIZE) * tilesX + ix / TILE_SIZE];
+    if (tile != NULL) {
+      uint64_t word = tile[(iy % TILE_SIZE) * TILE_WORDS + (ix % TILE_SIZE) / 64] >> (ix % 64);
+      if (n < 64)
+        word &= (uint64_t(1) << n) - 1;
+      bits |= word << i;
+    }
+    i += n;
+  }
+  return bits;
+}
+
+CImg<uint8_t> Canvas::assemble(int x0, int y0, int x1, int y1) const {
+  if (x0 > x1)
+    std::swap(x0, x1);
+  if (y0 > y1)
+    std::swap(y0, y1);
+  CImg<uint8_t> img(1 + x1 - x0, 1 + y1 - y0, 1, 1);
+  for (int y = y0; y <= y1; ++y) {
+    uint8_t* dst = img.data(0, y - y0);
+    for (int x = x0; x <= x1; x += 64) {
+      uint64_t bits = rowBits(x, y);
+      for (int i = 0; i < 64 && x + i <= x1; ++i)
+        *dst++ = (bits >> i) & 1 ? intensity[0] : 255;
+    }
+  }
+  return img;
+}
+
+bool Canvas::writeRows(ImageWriter& writer, int x0, int y0, int x1, int y1) {
+  std::vector<uint8_t> row(writer.rowBytes());
+  int band = -1;
+  for (int y = y0; y <= y1; ++y) {
+    // in bands only the band of the row is in memory
+    int iy = y - originY;
+    if (bandRows > 0 && iy >= 0 && iy < height && iy / bandRows != band) {
+      releaseBand();
+      band = iy / bandRows;
+      renderBand(band);
+    }
+
+    for (int x = x0; x <= x1; x += 64) {
+      uint64_t bits = rowBits(x, y);
+      if (x1 - x < 63)
+        bits &= (uint64_t(1) << (x1 - x + 1)) - 1;
+      // the first pixel goes to the highest bit of a byte
+      for (int i = 0; i < 8 && x + 8 * i <= x1; ++i) {
+        uint8_t byte = 0;
+        for (int b = 0; b < 8; ++b)
+          byte |= ((bits >> (8 * i + b)) & 1) << (7 - b);
+        row[(x - x0) / 8 + i] = byte;
+      }
+    }
+    writer.writeRow(row.data());
+    if ((y + 1) % TILE_SIZE == 0)
+      writer.flush();
+  }
+  releaseBand();
+  return writer.close() && !bandFailed;
+}
+
 void Canvas::dump(const string& filename, BoundingBox* crop) {
-  if(crop != NULL)
-    offscreen.crop(crop->ul.x, crop->ul.y, crop->lr.x, crop->lr.y, false).save(filename.c_str());
-  else
-    offscreen.save(filename.c_str());
+  flush();
+  int x0 = 0, y0 = 0, x1 = int(bedWidth) - 1, y1 = int(bedHeight) - 1;
+  if(crop != NULL) {
+    x0 = crop->ul.x;
+    y0 = crop->ul.y;
+    x1 = crop->lr.x;
+    y1 = crop->lr.y;
+  }
+
+  if (x0 > x1)
+    std::swap(x0, x1);
+  if (y0 > y1)
+    std::swap(y0, y1);
+
+  // the image is encoded straight from the bits where possible, without a copy of it
+  if (ImageWriter::isSupported(filename)) {
+    ImageWriter* writer = ImageWriter::open(filename, 1 + x1 - x0, 1 + y1 - y0);
+    if (writer == NULL || !writeRows(*writer, x0, y0, x1, y1))
+      Trace::singleton()->warn("Can't write image file.");
+    delete writer;
+  } else {
+    assemble(x0, y0, x1, y1).save(filename.c_str());
+  }
 }
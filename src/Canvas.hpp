@@ -2,23 +2,96 @@
 #define CANVAS_H_
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 #include "2D.hpp"
 #include <string>
 #include "CImg.hpp"
+#include "ImageWriter.hpp"
+#include "ThreadPool.hpp"
 
 using std::string;
 using cimg_library::CImg;
 
 class Canvas {
 public:
-  Canvas(dim bedWidth, dim bedHeight, dim screenWidth = 0, dim screenHeight = 0, BoundingBox* clip = NULL);
-  virtual ~Canvas() {};
-  void drawPixel(coord x0, coord y0, uint8_t r,uint8_t g,uint8_t b);
-  void drawLine(coord x0, coord y0, coord x1, coord y1);
-  void drawCut(coord x0, coord y0, coord x1, coord y1);
+  // the image only covers the region of the bed, in millimetres, if one is given
+  Canvas(dim bedWidth, dim bedHeight, dim screenWidth = 0, dim screenHeight = 0, BoundingBox* clip = NULL,
+      const BoundingBox* region = NULL);
+  // shows the last frame and closes the live window
+  virtual ~Canvas() {
+    if (presenter.joinable()) {
+      presenting = false;
+      presenter.join();
+    }
+    // in bands the tiles are in the mapping of the band
+    if (bandRows > 0)
+      releaseBand();
+    else
+      for (uint64_t* tile : tiles)
+        delete[] tile;
+    delete pool;
+    if (bandFd >= 0)
+      close(bandFd);
+  };
+  // false if the image can't be rendered, e.g. it doesn't fit into the memory budget
+  bool isValid() const {
+    return error.empty();
+  }
+  const string& getError() const {
+    return error;
+  }
+  // coordinates are in micrometres. the live window is only drawn by the presenter,
+  // these record what to draw.
+  void drawPixel(icoord x0, icoord y0, uint8_t r,uint8_t g,uint8_t b);
+  void drawLine(icoord x0, icoord y0, icoord x1, icoord y1);
+  void drawCut(icoord x0, icoord y0, icoord x1, icoord y1);
+  // the presenter shows what was recorded with the next frame anyway
   void update();
+  // rasterizes the pending cuts
+  void flush();
   void dump(const string& filename, BoundingBox* clip = NULL);
 private:
+  // the image is stored as tiles of TILE_SIZE^2 pixels, allocated when first drawn to.
+  // a pixel is a bit, set where it was cut. pixel x of a row is bit x % 64 of word x / 64.
+  // with more than one thread, cuts are binned into the tiles they pass, row of tiles by row
+  // of tiles, and rasterized tile by tile on the pool, at the latest after FLUSH_SEGMENTS cuts.
+  // with a memory budget the cuts are only collected per band of rows instead, and each band is
+  // rasterized when it is written out. the buckets of the bands are kept in a temporary file,
+  // up to BAND_CHUNK cuts at a time, so neither the image nor the cuts have to fit into memory.
+  // half of the share of the budget for the image goes to the tiles of a band, a quarter to the
+  // buffers of the buckets and a quarter to the cuts binned for rasterizing them.
+  static constexpr int TILE_SIZE = 256;
+  static constexpr int TILE_WORDS = TILE_SIZE / 64;
+  static constexpr size_t TILE_BYTES = TILE_SIZE * TILE_WORDS * sizeof(uint64_t);
+  static constexpr size_t FLUSH_SEGMENTS = 1 << 16;
+  static constexpr size_t BAND_CHUNK = 256;
+  static constexpr size_t MIN_BAND_CHUNK = 16;
+
+  struct PixelSegment {
+    int x0, y0, x1, y1;
+  };
+
+  // the cuts crossing the rows of a band: the full chunks in the file and the rest.
+  // a chunk is followed by the offset of the one written before it, or -1.
+  struct BandBucket {
+    off_t last = -1;
+    std::vector<PixelSegment> buffer;
+  };
+
+  // the live window is shown at most FRAME_RATE times per second
+  static constexpr int FRAME_RATE = 30;
+
+  // a line or a single pixel (x0 == x1, y0 == y1, isPixel) in window coordinates
+  struct ScreenPrimitive {
+    int16_t x0, y0, x1, y1;
+    uint8_t r, g, b;
+    bool isPixel;
+  };
+
   class SDL_Surface *screen;
   dim bedWidth;
   dim bedHeight;
@@ -27,12 +100,100 @@ private:
   dim screenHeight;
 
   BoundingBox* clip;
-  CImg<uint8_t> offscreen;
+  // the image in pixels of the bed
+  int originX;
+  int originY;
+  int width;
+  int height;
   uint8_t intensity[1];
   double scale;
 
-  void scaleCoordinate(coord& v) {
-    v= (coord)((double) v) * scale;
+  // NULL with a single thread
+  ThreadPool* pool;
+  int tilesX;
+  int tilesY;
+  std::vector<PixelSegment> pending;
+  // in bands only for the tiles of the band, the first one is tile binBase
+  std::vector<std::vector<uint32_t>> bins;
+  size_t binBase;
+  // the entries of all bins
+  size_t binned;
+  // the bytes of pending and bins that are rasterized at once in bands
+  size_t flushBytes;
+  // NULL for tiles nothing was drawn to yet
+  std::vector<uint64_t*> tiles;
+  // a multiple of TILE_SIZE. 0 unless rendering in bands
+  int bandRows;
+  std::vector<BandBucket> bands;
+  // the chunks of all bands. -1 unless rendering in bands
+  int bandFd;
+  off_t bandFileSize;
+  bool bandFailed;
+  // the cuts in a chunk
+  size_t bandChunk;
+  // the tiles of the band being written. NULL if there is none
+  uint64_t* bandStore;
+  size_t bandStoreBytes;
+  string error;
+
+  // owns the window: draws the recorded primitives and handles the events
+  std::thread presenter;
+  std::atomic<bool> presenting;
+  std::mutex recordMutex;
+  std::vector<ScreenPrimitive> recorded;
+
+  void present();
+  void record(const ScreenPrimitive& primitive);
+
+  void binCut(const PixelSegment& seg);
+  void bandCut(const PixelSegment& seg);
+  // adds cut i to the bins of the tiles it passes, within the rows of tiles [ty0, ty1]
+  void binSegment(uint32_t i, int ty0, int ty1);
+  // rasterizes the binned cuts, tile by tile
+  void rasterizeBins();
+  // rasterizes a cut on the calling thread, limited to the rows [clipY0, clipY1)
+  void rasterizeCut(const PixelSegment& seg, int clipY0, int clipY1);
+  // splits the budget for the image into bands. false with the error set if it is too small.
+  bool initBands(size_t budget);
+  // rasterizes the cuts of the band, a chunk at a time, and drops its bucket
+  void renderBand(int b);
+  // frees the tiles of the band rendered last
+  void releaseBand();
+  uint64_t* touchTile(size_t t);
+  // the pixels [x, x + 64) of row y of the bed, as bits. pixels outside of the bed are set.
+  uint64_t rowBits(int x, int y) const;
+  // the pixels [x0, x1] x [y0, y1] of the bed. pixels outside of the bed are black
+  CImg<uint8_t> assemble(int x0, int y0, int x1, int y1) const;
+  // streams the same area to the writer, a band of tiles at a time. false on errors.
+  // only in bands is a band rasterized, written and freed in turn. otherwise the cuts can land
+  // anywhere until the job ends, so every tile drawn to stays in memory until the dump.
+  bool writeRows(ImageWriter& writer, int x0, int y0, int x1, int y1);
+
+  // x and y within the tile
+  static void setPixel(uint64_t* tile, int x, int y) {
+    tile[y * TILE_WORDS + x / 64] |= uint64_t(1) << (x % 64);
+  }
+
+  // the pixels [x0, x1] of row y of the tile, a word at a time
+  static void setSpan(uint64_t* tile, int x0, int x1, int y) {
+    uint64_t* row = tile + y * TILE_WORDS;
+    for (int w = x0 / 64; w <= x1 / 64; ++w) {
+      uint64_t mask = ~uint64_t(0);
+      if (w == x0 / 64)
+        mask &= ~uint64_t(0) << (x0 % 64);
+      if (w == x1 / 64)
+        mask &= ~uint64_t(0) >> (63 - x1 % 64);
+      row[w] |= mask;
+    }
+  }
+
+  // the image has a resolution of 0.1 mm
+  static int toPixel(icoord v) {
+    return v / 100;
+  }
+
+  coord toScreen(icoord v) {
+    return v / 1000.0 * scale;
   }
 };
 
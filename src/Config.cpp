@@ -1,9 +1,59 @@
 #include "Config.hpp"
 #include <getopt.h>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <thread>
+#include "ImageWriter.hpp"
 
 Config* Config::instance = NULL;
 
+enum LONG_OPTION {
+	OPT_MEM_BUDGET = 256
+};
+
+static const struct option LONG_OPTIONS[] = {
+	{ "mem-budget", required_argument, NULL, OPT_MEM_BUDGET },
+	{ NULL, 0, NULL, 0 }
+};
+
+// a number of bytes with an optional k, M or G suffix. 0 if it isn't one.
+static size_t parseSize(const char* str) {
+	char* end;
+	size_t size = strtoull(str, &end, 10);
+	if (end == str)
+		return 0;
+	switch (*end) {
+	case 'k':
+	case 'K':
+		size <<= 10;
+		++end;
+		break;
+	case 'm':
+	case 'M':
+		size <<= 20;
+		++end;
+		break;
+	case 'g':
+	case 'G':
+		size <<= 30;
+		++end;
+		break;
+	}
+	return *end == '\0' ? size : 0;
+}
+
+// a whole number of mm up to max. -1 if it isn't one.
+static int parseMillimeters(const char* str, long max) {
+	char* end;
+	errno = 0;
+	long mm = strtol(str, &end, 10);
+	if (end == str || *end != '\0' || errno == ERANGE || mm < 0 || mm > max)
+		return -1;
+	return mm;
+}
+
 Config* Config::singleton() {
 	if (instance == NULL)
 		instance = new Config();
@@ -25,10 +75,18 @@ void Config::printUsage() {
 			"  -v <filename>     Output the vector pass to the given filename\n");
 	fprintf(stderr,
 			"  -r <filename>     Output the raster pass to the given filename\n");
+	fprintf(stderr,
+			"  -g <filename>     Write the compiled geometry of the job to the given .geo file. It can be rendered instead of the RD-file\n");
 	fprintf(stderr,
 			"  -d <level>        Set the verbosity level (quiet/info/warn/debug)\n");
 	fprintf(stderr,
 			"  -s <dimension>    Configure the size of the live rendering window. e.g. 1024x768\n");
+	fprintf(stderr,
+			"  -j <threads>      Number of worker threads (default: number of cores)\n");
+	fprintf(stderr,
+			"  -p <margin>       Prescan the cuts and only allocate the image for their bounding box plus <margin> mm (0 to 10000)\n");
+	fprintf(stderr,
+			"  --mem-budget <bytes>  Keep the memory for reading, decoding and the image within <bytes> (k, M, G, at least 1M). The image is rendered in bands and the cuts are kept in a temporary file. Needs a .pbm, .pgm or .png image\n");
 	exit(1);
 }
 
@@ -36,7 +94,7 @@ void Config::parseCommandLine(int argc, char *argv[]) {
 	int c;
 	opterr = 0;
 	while (optind < argc) {
-		while ((c = getopt(argc, argv, "iac:r:v:d:s:")) != -1) {
+		while ((c = getopt_long(argc, argv, "iac:r:v:g:d:s:j:p:", LONG_OPTIONS, NULL)) != -1) {
 			switch (c) {
 			case 'i':
 				this->interactive = true;
@@ -53,6 +111,9 @@ void Config::parseCommandLine(int argc, char *argv[]) {
 			case 'v':
 				this->vectorFilename = optarg;
 				break;
+			case 'g':
+				this->geometryFilename = optarg;
+				break;
 			case 'b':
 				this->combinedFilename = optarg;
 				break;
@@ -69,8 +130,27 @@ void Config::parseCommandLine(int argc, char *argv[]) {
 					printUsage();
 				break;
 			case 's':
+#ifdef PCLINT_USE_SDL
 				this->screenSize = BoundingBox::createFromGeometryString(
 						optarg);
+#else
+				fprintf(stderr, "Built without a live window, ignoring -s\n");
+#endif
+				break;
+			case 'j':
+				this->jobs = strtoul(optarg, NULL, 10);
+				if (this->jobs == 0)
+					printUsage();
+				break;
+			case 'p':
+				this->prescanMargin = parseMillimeters(optarg, MAX_PRESCAN_MARGIN);
+				if (this->prescanMargin < 0)
+					printUsage();
+				break;
+			case OPT_MEM_BUDGET:
+				this->memBudget = parseSize(optarg);
+				if (this->memBudget < MIN_MEM_BUDGET)
+					printUsage();
 				break;
 			case ':':
 				printUsage();
@@ -89,9 +169,17 @@ void Config::parseCommandLine(int argc, char *argv[]) {
 		}
 	}
 
+	if (this->jobs == 0)
+		this->jobs = std::max(1u, std::thread::hardware_concurrency());
+
 	// Required parameters
 	if (!this->ifilename) {
 		printUsage();
 	}
+
+	// the bands are streamed into the image as they are done
+	if (this->memBudget > 0 && (this->vectorFilename == NULL
+			|| !ImageWriter::isSupported(this->vectorFilename)))
+		printUsage();
 }
 
@@ -1,6 +1,7 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+#include <cstddef>
 #include "2D.hpp"
 
 #define STRINGIFY(x) #x
@@ -11,7 +12,7 @@ enum DEBUG_LEVEL {
 };
 class Config {
 private:
-  Config(): interactive(false), autocrop(false), clip(NULL), screenSize(NULL), ifilename(NULL), rasterFilename(NULL), vectorFilename(NULL), combinedFilename(NULL), debugLevel(LVL_WARN) {};
+  Config(): interactive(false), autocrop(false), clip(NULL), screenSize(NULL), ifilename(NULL), rasterFilename(NULL), vectorFilename(NULL), combinedFilename(NULL), geometryFilename(NULL), debugLevel(LVL_WARN), jobs(0), prescanMargin(-1), memBudget(0) {};
   static Config* instance;
 public:
   bool interactive;
@@ -22,10 +23,31 @@ public:
   char *rasterFilename;
   char *vectorFilename;
   char *combinedFilename;
+  char *geometryFilename;
   DEBUG_LEVEL debugLevel;
+  unsigned int jobs;
+  // in millimetres. negative if the canvas covers the whole bed
+  int prescanMargin;
+  // larger than any bed, keeps the margin in micrometres far from overflowing
+  static constexpr long MAX_PRESCAN_MARGIN = 10000;
+  // in bytes for everything that grows with the job or the image. 0 if it isn't limited
+  size_t memBudget;
+  // less can't even hold the buffers for reading and decoding
+  static constexpr size_t MIN_MEM_BUDGET = 1 << 20;
 
   static Config* singleton();
 
+  // the shares of the memory budget, 0 if there is none
+  size_t inputBudget() const {
+    return memBudget / 8;
+  }
+  size_t decodeBudget() const {
+    return memBudget / 8;
+  }
+  size_t imageBudget() const {
+    return memBudget - inputBudget() - decodeBudget();
+  }
+
   void parseCommandLine(int argc, char *argv[]);
   void printUsage();
 };
@@ -24,576 +24,389 @@ string makeFixedString(float var, int roundDigits) {
 	return strVal;
 }
 
-uint64_t parseUnsignedValue(const Data& data) {
-	uint64_t value = 0;
-	for (auto& b : data) {
-		value *= 0x80;
-		value += b;
-	}
-	return value;
+// the fixed width parsers have to agree with the generic ones above
+constexpr uint8_t FIELD_300000[5] = { 0x00, 0x00, 0x12, 0x27, 0x60 };
+constexpr uint8_t FIELD_MINUS_1[5] = { 0x7F, 0x7F, 0x7F, 0x7F, 0x7F };
+constexpr uint8_t FIELD_MINUS_2000000[5] = { 0x7F, 0x7F, 0x05, 0x77, 0x00 };
+constexpr uint8_t FIELD_8191[2] = { 0x3F, 0x7F };
+constexpr uint8_t FIELD_MINUS_8192[2] = { 0x40, 0x00 };
+constexpr uint8_t FIELD_MINUS_3000[2] = { 0x68, 0x48 };
+static_assert(parseUnsigned<5>(FIELD_300000) == 300000, "parseUnsigned<5>");
+static_assert(parseSigned<5>(FIELD_300000) == 300000, "parseSigned<5>");
+static_assert(parseSigned<5>(FIELD_MINUS_1) == -1, "parseSigned<5>");
+static_assert(parseSigned<5>(FIELD_MINUS_2000000) == -2000000, "parseSigned<5>");
+static_assert(parseUnsigned<2>(FIELD_8191) == 8191, "parseUnsigned<2>");
+static_assert(parseSigned<2>(FIELD_8191) == 8191, "parseSigned<2>");
+static_assert(parseSigned<2>(FIELD_MINUS_8192) == -8192, "parseSigned<2>");
+static_assert(parseSigned<2>(FIELD_MINUS_3000) == -3000, "parseSigned<2>");
+static_assert(parseUnsigned<1>(FIELD_8191 + 1) == 0x7F, "parseUnsigned<1>");
+
+// decoders fill in the fields of a command which passed the length check
+static void decodeNothing(Command& cmd) {
 }
 
-int64_t parseSignedValue(const Data& data) {
-	if (data.size() >= 1 && data[0] < 0x40) {
-		return parseUnsignedValue(data);
-	}
-	Data dataInv;
-	for (auto& b : data) {
-		dataInv.push_back(0x7F ^ b);
-	}
-	int64_t valueInv = parseUnsignedValue(dataInv);
-	return -(valueInv + 1);
+static void decodeCoords(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.isMax = data[1] == 0x07;
+	cmd.x = parseSigned<5>(data.begin() + 2);
+	cmd.y = parseSigned<5>(data.begin() + 7);
 }
 
-struct CmdEmpty: CmdBase {
-	CmdEmpty(Data& data) :
-			CmdBase(data) {
-	}
-	virtual ~CmdEmpty() {
-	}
-	virtual void calcStats(Stats& stats) override {
-		++stats.empty;
-	}
-	virtual TERM_COLORS getColor() override {
-		return RED;
-	}
-	virtual string getName() override {
-		return "Empty command";
-	}
-	virtual std::vector<Param> getParams() {
-		return {};
-	}
+static void decodeCutMoveAbs(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.isCut = data[0] == 0xA8;
+	cmd.x = parseSigned<5>(data.begin() + 1);
+	cmd.y = parseSigned<5>(data.begin() + 6);
+}
 
-	virtual void process(ProcState& procState) override {
+static void decodeCutMoveRel(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.isCut = data[0] == 0xA9;
+	cmd.x = parseSigned<2>(data.begin() + 1);
+	cmd.y = parseSigned<2>(data.begin() + 3);
+}
 
-	}
-};
+static void decodeCutMoveRel1(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.isCut = data[0] == 0xAA || data[0] == 0xAB;
+	cmd.isY = data[0] == 0x8B || data[0] == 0xAB;
+	int64_t xy = parseSigned<2>(data.begin() + 1);
+	cmd.x = cmd.isY ? 0 : xy;
+	cmd.y = cmd.isY ? xy : 0;
+}
 
-struct CmdGood: CmdBase {
-	CmdGood(Data& data) :
-			CmdBase(data) {
-	}
-	virtual ~CmdGood() {
-	}
+static void decodeEnableDisable(Command& cmd) {
+	cmd.value = parseUnsigned<1>(cmd.data.begin() + 2);
+}
 
-	virtual void calcStats(Stats& stats) override {
-		++stats.good;
-	}
-	virtual TERM_COLORS getColor() override {
-		return GREEN;
-	}
-	virtual void process(ProcState& procState) override {
+static void decodeSetColorLayer(Command& cmd) {
+	cmd.layer = parseUnsigned<1>(cmd.data.begin() + 2);
+	cmd.value = parseUnsigned<5>(cmd.data.begin() + 3);
+}
 
-	}
-};
+static void decodeSetLayer(Command& cmd) {
+	cmd.layer = parseUnsigned<1>(cmd.data.begin() + 2);
+}
 
-struct CmdIncomplete: CmdBase {
-	CmdIncomplete(Data& data) :
-			CmdBase(data) {
-	}
-	virtual ~CmdIncomplete() {
-	}
+static void decodeSetPwr(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.laserNo = ((data[1] & 0x20) >> 5) + 1;
+	cmd.isMax = ((data[1] & 0x02) != 0);
+	cmd.value = parseUnsigned<2>(data.begin() + 2);
+}
 
-	virtual void calcStats(Stats& stats) override {
-		++stats.incomplete;
-	}
-	virtual TERM_COLORS getColor() override {
-		return PINK;
-	}
-	virtual string getName() override {
-		return "Incomplete command";
-	}
-	virtual std::vector<Param> getParams() {
-		return {};
-	}
+static void decodeSetPwrLayer(Command& cmd) {
+	const Data& data = cmd.data;
+	cmd.laserNo = ((data[1] & 0x70) >> 4) - 2;
+	cmd.isMax = ((data[1] & 0x02) != 0);
+	cmd.layer = parseUnsigned<1>(data.begin() + 2);
+	cmd.value = parseUnsigned<2>(data.begin() + 3);
+}
 
-	virtual void process(ProcState& procState) override {
+static void decodeSetSpeed(Command& cmd) {
+	cmd.value = parseUnsigned<5>(cmd.data.begin() + 2);
+}
 
-	}
-};
+static void decodeSetSpeedLayer(Command& cmd) {
+	cmd.layer = parseUnsigned<1>(cmd.data.begin() + 2);
+	cmd.value = parseUnsigned<5>(cmd.data.begin() + 3);
+}
 
-struct CmdUnknown: CmdBase {
-	CmdUnknown(Data& data) :
-			CmdBase(data) {
-	}
-	virtual ~CmdUnknown() {
-	}
+// pretty printing
+static string nameEmpty(const Command& cmd) {
+	return "Empty command";
+}
 
-	virtual void calcStats(Stats& stats) override {
-		++stats.unknown;
-	}
-	virtual TERM_COLORS getColor() override {
-		return YELLOW;
-	}
-	virtual string getName() override {
-		return "Unknown command";
-	}
+static string nameIncomplete(const Command& cmd) {
+	return "Incomplete command";
+}
 
-	virtual std::vector<Param> getParams() {
-		return {};
-	}
+static string nameUnknown(const Command& cmd) {
+	return "Unknown command";
+}
 
-	virtual void process(ProcState& procState) override {
+static string nameCoords(const Command& cmd) {
+	return string() + (cmd.isMax ? "Max" : "Min") + "imum absolute coordinates";
+}
 
-	}
-};
+static string nameCutMoveAbs(const Command& cmd) {
+	return string() + (cmd.isCut ? "Cut" : "Move") + " to absolute position";
+}
 
-struct CmdCoords: CmdGood {
-	bool isMax;
-	coord x;
-	coord y;
-	CmdCoords(Data& data) :
-			CmdGood(data) {
-		isMax = data[1] == 0x07;
-		x = parseSignedValue(Data(data.begin() + 2, data.begin() + 7));
-		y = parseSignedValue(Data(data.begin() + 7, data.begin() + 12));
-	}
-	virtual ~CmdCoords() {
-	}
+static string nameCutMoveRel(const Command& cmd) {
+	return string() + (cmd.isCut ? "Cut" : "Move") + " to relative position";
+}
 
-	virtual string getName() override {
-		return string() + (isMax ? "Max" : "Min") + "imum absolute coordinates";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			ParamPhys("x", x, 1e-3, 3, "mm"),
-			ParamPhys("y", y, 1e-3, 3, "mm")
-		};
-	}
+static string nameCutMoveRel1(const Command& cmd) {
+	return string() + (cmd.isCut ? "Cut" : "Move") + " to relative position in "
+			+ (cmd.isY ? "Y" : "X") + " direction";
+}
 
-	virtual void process(ProcState& procState) override {
-		procState.setLimits(isMax, x, y);
-	}
-};
+static string nameEnableDisable(const Command& cmd) {
+	return "Enable / Disable helper devices";
+}
 
-struct CmdCutMoveAbs: CmdGood {
-	bool isCut;
-	coord x;
-	coord y;
-	CmdCutMoveAbs(Data& data) :
-			CmdGood(data) {
-		isCut = data[0] == 0xA8;
-		x = parseSignedValue(Data(data.begin() + 1, data.begin() + 6));
-		y = parseSignedValue(Data(data.begin() + 6, data.begin() + 11));
-	}
+static string nameSetColorLayer(const Command& cmd) {
+	return "Set color for layer";
+}
 
-	virtual string getName() override {
-		return string() + (isCut ? "Cut" : "Move") + " to absolute position";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			ParamPhys("x", x, 1e-3, 3, "mm"),
-			ParamPhys("y", y, 1e-3, 3, "mm")
-		};
-	}
-	virtual void process(ProcState& procState) override {
-		if (isCut) {
-			procState.cutAbs(x, y);
-		} else {
-			procState.moveAbs(x, y);
-		}
-	}
-};
+static string nameSetCurLayer(const Command& cmd) {
+	return "Set current layer";
+}
 
-struct CmdCutMoveRel: CmdGood {
-	bool isCut;
-	coord x;
-	coord y;
+static string nameSetMaxLayer(const Command& cmd) {
+	return "Set maximum layer number";
+}
 
-	CmdCutMoveRel(Data &data) :
-			CmdGood(data) {
-		isCut = data[0] == 0xA9;
-		x = parseSignedValue(Data(data.begin() + 1, data.begin() + 3));
-		y = parseSignedValue(Data(data.begin() + 3, data.begin() + 5));
-	}
-	virtual string getName() {
-		return string() + (isCut ? "Cut" : "Move") + " to relative position";
-	}
-	virtual std::vector<Param> getParams() {
-		return {
-			ParamPhys("x", x, 1e-3, 3, "mm"),
-			ParamPhys("y", y, 1e-3, 3, "mm")
-		};
-	}
-	virtual void process(ProcState& procState) {
-		if (isCut) {
-			procState.cutRel(x, y);
-		} else {
-			procState.moveRel(x, y);
-		}
-	}
+static string nameSetPwr(const Command& cmd) {
+	return string() + "Set " + (cmd.isMax ? "max" : "min")
+			+ "imum power for laser " + std::to_string(cmd.laserNo);
+}
+
+static string nameSetPwrLayer(const Command& cmd) {
+	return string() + "Set " + (cmd.isMax ? "max" : "min") + "imum power for laser "
+			+ std::to_string(cmd.laserNo) + " for layer";
+}
+
+static string nameSetSpeed(const Command& cmd) {
+	return "Set speed";
+}
+
+static string nameSetSpeedLayer(const Command& cmd) {
+	return "Set speed for layer";
+}
+
+static ParamList paramsNone(const Command& cmd, Arena& arena) {
+	return ParamList(arena);
+}
+
+static ParamList paramsXY(const Command& cmd, Arena& arena) {
+	return ParamList({
+		ParamPhys("x", cmd.x, 1e-3, 3, "mm"),
+		ParamPhys("y", cmd.y, 1e-3, 3, "mm")
+	}, arena);
+}
+
+static ParamList paramsCutMoveRel1(const Command& cmd, Arena& arena) {
+	return ParamList({
+		ParamPhys(cmd.isY ? "y" : "x", cmd.isY ? cmd.y : cmd.x, 1e-3, 3, "mm")
+	}, arena);
+}
+
+static ParamList paramsEnableDisable(const Command& cmd, Arena& arena) {
+	return ParamList({
+		Param("air blower", (cmd.value & 0x01) != 0 ? "on" : "off"),
+		Param("unknown devices", byteToHexString(cmd.value & 0x7E))
+	}, arena);
+}
+
+static ParamList paramsSetColorLayer(const Command& cmd, Arena& arena) {
+	return ParamList({
+		Param("layer", std::to_string(cmd.layer)),
+		Param("red", byteToHexString(cmd.value & 0xFF)),
+		Param("green", byteToHexString(cmd.value >> 8 & 0xFF)),
+		Param("blue", byteToHexString(cmd.value >> 16 & 0xFF))
+	}, arena);
+}
+
+static ParamList paramsLayer(const Command& cmd, Arena& arena) {
+	return ParamList({
+		Param("layer", std::to_string(cmd.layer))
+	}, arena);
+}
+
+static ParamList paramsSetPwr(const Command& cmd, Arena& arena) {
+	return ParamList({
+		ParamPhys("power", cmd.value, 100.0 / 0x3FFF, 2, "%")
+	}, arena);
+}
+
+static ParamList paramsSetPwrLayer(const Command& cmd, Arena& arena) {
+	return ParamList({
+		Param("layer", std::to_string(cmd.layer)),
+		ParamPhys("power", cmd.value, 100.0 / 0x3FFF, 2, "%")
+	}, arena);
+}
+
+static ParamList paramsSetSpeed(const Command& cmd, Arena& arena) {
+	return ParamList({
+		ParamPhys("speed", cmd.value, 1e-3, 3, "mm/s")
+	}, arena);
+}
+
+static ParamList paramsSetSpeedLayer(const Command& cmd, Arena& arena) {
+	return ParamList({
+		Param("layer", std::to_string(cmd.layer)),
+		ParamPhys("speed", cmd.value, 1e-3, 3, "mm/s")
+	}, arena);
+}
+
+// everything there is to know about a command type. indexed by CMD_TYPE.
+struct CmdSpec {
+	CMD_TYPE type;
+	size_t Stats::* counter;
+	TERM_COLORS color;
+	void (*decode)(Command& cmd);
+	string (*name)(const Command& cmd);
+	ParamList (*params)(const Command& cmd, Arena& arena);
 };
 
-struct CmdCutMoveRel1: CmdGood {
-	bool isCut;
-	bool isY;
-	coord xy;
-	CmdCutMoveRel1(Data& data) :
-			CmdGood(data) {
-		isCut = data[0] == 0xAA || data[0] == 0xAB;
-		isY = data[0] == 0x8B || data[0] == 0xAB;
-		xy = parseSignedValue(Data(data.begin() + 1, data.begin() + 3));
-	}
-	virtual string getName() override {
-		return string() + (isCut ? "Cut" : "Move") + " to relative position in "
-				+ (isY ? "Y" : "X") + " direction";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			ParamPhys(isY ? "y" : "x", xy, 1e-3, 3, "mm")
-		};
-	}
-	virtual void process(ProcState& procState) override {
-		coord x = isY ? 0 : xy;
-		coord y = isY ? xy : 0;
-		if (isCut) {
-			procState.cutRel(x, y);
-		} else {
-			procState.moveRel(x, y);
-		}
-	}
+constexpr CmdSpec CMD_SPECS[] = {
+	{ CMD_EMPTY, &Stats::empty, RED, decodeNothing, nameEmpty, paramsNone },
+	{ CMD_INCOMPLETE, &Stats::incomplete, PINK, decodeNothing, nameIncomplete, paramsNone },
+	{ CMD_UNKNOWN, &Stats::unknown, YELLOW, decodeNothing, nameUnknown, paramsNone },
+	{ CMD_COORDS, &Stats::good, GREEN, decodeCoords, nameCoords, paramsXY },
+	{ CMD_CUT_MOVE_ABS, &Stats::good, GREEN, decodeCutMoveAbs, nameCutMoveAbs, paramsXY },
+	{ CMD_CUT_MOVE_REL, &Stats::good, GREEN, decodeCutMoveRel, nameCutMoveRel, paramsXY },
+	{ CMD_CUT_MOVE_REL1, &Stats::good, GREEN, decodeCutMoveRel1, nameCutMoveRel1, paramsCutMoveRel1 },
+	{ CMD_ENABLE_DISABLE, &Stats::good, GREEN, decodeEnableDisable, nameEnableDisable, paramsEnableDisable },
+	{ CMD_SET_COLOR_LAYER, &Stats::good, GREEN, decodeSetColorLayer, nameSetColorLayer, paramsSetColorLayer },
+	{ CMD_SET_CUR_LAYER, &Stats::good, GREEN, decodeSetLayer, nameSetCurLayer, paramsLayer },
+	{ CMD_SET_MAX_LAYER, &Stats::good, GREEN, decodeSetLayer, nameSetMaxLayer, paramsLayer },
+	{ CMD_SET_PWR, &Stats::good, GREEN, decodeSetPwr, nameSetPwr, paramsSetPwr },
+	{ CMD_SET_PWR_LAYER, &Stats::good, GREEN, decodeSetPwrLayer, nameSetPwrLayer, paramsSetPwrLayer },
+	{ CMD_SET_SPEED, &Stats::good, GREEN, decodeSetSpeed, nameSetSpeed, paramsSetSpeed },
+	{ CMD_SET_SPEED_LAYER, &Stats::good, GREEN, decodeSetSpeedLayer, nameSetSpeedLayer, paramsSetSpeedLayer }
 };
 
-struct CmdEnableDisable: CmdGood {
-	dim devices;
-	bool airBlower;
-	CmdEnableDisable(Data& data) :
-			CmdGood(data) {
-		devices = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-		airBlower = (devices & 0x01) != 0;
-	}
-	virtual string getName() override {
-		return "Enable / Disable helper devices";
+constexpr bool specsInOrder() {
+	for (size_t i = 0; i < sizeof(CMD_SPECS) / sizeof(CMD_SPECS[0]); ++i) {
+		if (CMD_SPECS[i].type != CMD_TYPE(i))
+			return false;
 	}
+	return true;
+}
+static_assert(specsInOrder(), "CMD_SPECS has to be in CMD_TYPE order");
+
+// the instruction set: opcode, sub-opcode (data[1]) if the opcode has any, command type and instruction length.
+// new instructions only need to be added here and to CMD_SPECS, and to Command::process if they change the state.
+struct OpcodeSpec {
+	uint8_t opcode;
+	int16_t sub;
+	CMD_TYPE type;
+	uint8_t length;
+};
 
-	virtual std::vector<Param> getParams() override {
-		return {
-			Param("air blower", airBlower ? "on" : "off"),
-			Param("unknown devices", byteToHexString(devices & 0x7E))
-		};
-	}
-	virtual void process(ProcState& procState) override {
-	}
+constexpr int16_t NO_SUB = -1;
+
+constexpr OpcodeSpec OPCODES[] = {
+	{ 0x88, NO_SUB, CMD_CUT_MOVE_ABS, 11 },
+	{ 0xA8, NO_SUB, CMD_CUT_MOVE_ABS, 11 },
+	{ 0x89, NO_SUB, CMD_CUT_MOVE_REL, 5 },
+	{ 0xA9, NO_SUB, CMD_CUT_MOVE_REL, 5 },
+	{ 0x8A, NO_SUB, CMD_CUT_MOVE_REL1, 3 },
+	{ 0x8B, NO_SUB, CMD_CUT_MOVE_REL1, 3 },
+	{ 0xAA, NO_SUB, CMD_CUT_MOVE_REL1, 3 },
+	{ 0xAB, NO_SUB, CMD_CUT_MOVE_REL1, 3 },
+	{ 0xC6, 0x01, CMD_SET_PWR, 4 },
+	{ 0xC6, 0x02, CMD_SET_PWR, 4 },
+	{ 0xC6, 0x21, CMD_SET_PWR, 4 },
+	{ 0xC6, 0x22, CMD_SET_PWR, 4 },
+	{ 0xC6, 0x31, CMD_SET_PWR_LAYER, 5 },
+	{ 0xC6, 0x32, CMD_SET_PWR_LAYER, 5 },
+	{ 0xC6, 0x41, CMD_SET_PWR_LAYER, 5 },
+	{ 0xC6, 0x42, CMD_SET_PWR_LAYER, 5 },
+	{ 0xC9, 0x02, CMD_SET_SPEED, 7 },
+	{ 0xC9, 0x04, CMD_SET_SPEED_LAYER, 8 },
+	{ 0xCA, 0x01, CMD_ENABLE_DISABLE, 3 },
+	{ 0xCA, 0x02, CMD_SET_CUR_LAYER, 3 },
+	{ 0xCA, 0x06, CMD_SET_COLOR_LAYER, 8 },
+	{ 0xCA, 0x22, CMD_SET_MAX_LAYER, 3 },
+	{ 0xE7, 0x03, CMD_COORDS, 12 },
+	{ 0xE7, 0x07, CMD_COORDS, 12 }
 };
 
-struct CmdSetColorLayer: CmdGood {
-	dim layer;
-	dim color;
-	uint8_t red;
-	uint8_t green;
-	uint8_t blue;
-
-	CmdSetColorLayer(Data& data) :
-			CmdGood(data) {
-		layer = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-		color = parseUnsignedValue(Data(data.begin() + 3, data.begin() + 8));
-		red = color & 0xFF;
-		green = color >> 8 & 0xFF;
-		blue = color >> 16 & 0xFF;
-	}
-	virtual string getName() override {
-		return "Set color for layer";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			Param("layer", std::to_string(layer)),
-			Param("red", byteToHexString(red)),
-			Param("green", byteToHexString(green)),
-			Param("blue", byteToHexString(blue))
-		};
-	}
-	virtual void process(ProcState& procState) override {
-		procState.setLayerColor(layer, red, green, blue);
-	}
+// two level lookup generated from OPCODES at compile time:
+// opcodes[data[0] - 0x80] either is the entry itself or selects a sub-table indexed by data[1].
+// unknown instructions map to CMD_UNKNOWN with length 0, so they fail the length check.
+struct DispatchEntry {
+	CMD_TYPE type = CMD_UNKNOWN;
+	uint8_t length = 0;
 };
 
-struct CmdSetCurLayer: CmdGood {
-	dim layer;
-	CmdSetCurLayer(Data& data) :
-			CmdGood(data) {
-		layer = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-	}
-	virtual string getName() override {
-		return "Set current layer";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			Param("layer", std::to_string(layer))
-		};
-	}
-	virtual void process(ProcState& procState) override {
-		procState.setCurLayer(layer);
-	}
+struct DispatchOpcode {
+	uint8_t subTable = 0; // 1-based, 0 means no sub-opcode
+	DispatchEntry entry;
 };
 
-struct CmdSetMaxLayer: CmdGood {
-	dim layer;
-	CmdSetMaxLayer(Data& data) :
-			CmdGood(data) {
-		layer = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-	}
-	virtual string getName() override {
-		return "Set maximum layer number";
-	}
-	virtual std::vector<Param> getParams() override {
-		return {
-			Param("layer", std::to_string(layer))
-		};
-	}
-	virtual void process(ProcState& procState) override {
-		procState.setMaxLayer(layer);
+constexpr size_t countSubTables() {
+	size_t count = 0;
+	for (size_t i = 0; i < sizeof(OPCODES) / sizeof(OPCODES[0]); ++i) {
+		bool first = OPCODES[i].sub != NO_SUB;
+		for (size_t j = 0; j < i && first; ++j)
+			first = OPCODES[j].opcode != OPCODES[i].opcode;
+		if (first)
+			++count;
 	}
+	return count;
+}
+
+struct DispatchTable {
+	DispatchOpcode opcodes[0x80];
+	DispatchEntry subTables[countSubTables()][0x100];
 };
 
-struct CmdSetPwr: CmdGood {
-	int16_t laserNo;
-	bool isMax;
-	dim pwr;
-	CmdSetPwr(Data& data) :
-			CmdGood(data) {
-		laserNo = ((data[1] & 0x20) >> 5) + 1;
-		isMax = ((data[1] & 0x02) != 0);
-		pwr = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 4));
+constexpr DispatchTable makeDispatchTable() {
+	DispatchTable table;
+	uint8_t numSubTables = 0;
+	for (const OpcodeSpec& op : OPCODES) {
+		DispatchOpcode& d = table.opcodes[op.opcode - 0x80];
+		if (op.sub == NO_SUB) {
+			d.entry = { op.type, op.length };
+		} else {
+			if (d.subTable == 0)
+				d.subTable = ++numSubTables;
+			table.subTables[d.subTable - 1][op.sub] = { op.type, op.length };
+		}
 	}
+	return table;
+}
 
-	virtual string getName() override {
-		return string() + "Set " + (isMax ? "max" : "min")
-				+ "imum power for laser " + std::to_string(laserNo);
-	}
+constexpr DispatchTable DISPATCH = makeDispatchTable();
 
-	virtual std::vector<Param> getParams() override {
-		return {
-			ParamPhys("power", pwr, 100.0 / 0x3FFF, 2, "%")
-		};
+Command parseCommand(const Data& data) {
+	if (data.size() < 1) {
+		return Command(CMD_EMPTY, data);
 	}
-	virtual void process(ProcState& procState) override {
-		procState.setPwr(pwr);
+	if (data[0] < 0x80) {
+		return Command(CMD_INCOMPLETE, data);
 	}
-};
-
-struct CmdSetPwrLayer : CmdGood {
-	int16_t laserNo;
-	int16_t layer;
-	bool isMax;
-	dim pwr;
-
-	CmdSetPwrLayer(Data& data) : CmdGood(data) {
-    laserNo = ((data[1] & 0x70) >> 4) - 2;
-    isMax = ((data[1] & 0x02) != 0);
-    layer = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-    pwr = parseUnsignedValue(Data(data.begin() + 3, data.begin() + 5));
-  }
-  virtual string getName() override {
-    return string() + "Set " + (isMax ? "max" : "min") + "imum power for laser "
-           + std::to_string(laserNo) + " for layer";
-  }
-
-  virtual std::vector<Param> getParams() override {
-    return {
-      Param("layer", std::to_string(layer)),
-      ParamPhys("power", pwr, 100.0 / 0x3FFF, 2, "%")
-    };
-  }
-  virtual void process(ProcState& procState) override {
-    procState.setLayerPwr(layer, pwr);
-  }
-};
 
-struct CmdSetSpeed : CmdGood {
-	dim speed;
-CmdSetSpeed(Data& data) : CmdGood(data) {
-    speed = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 7));
-  }
-  virtual string getName() override {
-    return "Set speed";
-  }
-  virtual std::vector<Param> getParams() override {
-    return {
-      ParamPhys("speed", speed, 1e-3, 3, "mm/s")
-    };
-  }
-  virtual void process(ProcState& procState) override {
-	  procState.setSpeed(speed);
-  }
-};
-
-struct CmdSetSpeedLayer : CmdGood {
-	int16_t layer;
-	dim speed;
-	CmdSetSpeedLayer(Data& data) : CmdGood(data) {
-    layer = parseUnsignedValue(Data(data.begin() + 2, data.begin() + 3));
-    speed = parseUnsignedValue(Data(data.begin() + 3, data.begin() + 8));
-  }
-
-  virtual string getName() override {
-    return "Set speed for layer";
-  }
-  virtual std::vector<Param> getParams() override {
-    return {
-      Param("layer", std::to_string(layer)),
-      ParamPhys("speed", speed, 1e-3, 3, "mm/s")
-    };
-  }
-
-  virtual void process(ProcState& procState) override {
-    procState.setLayerSpeed(layer, speed);
-  }
-};
+	const DispatchOpcode& op = DISPATCH.opcodes[data[0] - 0x80];
+	const DispatchEntry* entry = &op.entry;
+	if (op.subTable != 0) {
+		if (data.size() < 2)
+			return Command(CMD_UNKNOWN, data);
+		entry = &DISPATCH.subTables[op.subTable - 1][data[1]];
+	}
 
-CmdBase* parseCmdCoords(Data& data) {
-	if (data.size() != 12 || data[0] != 0xE7
-			|| (data[1] != 0x03 && data[1] != 0x07)) {
-		return new CmdUnknown(data);
+	if (data.size() != entry->length) {
+		return Command(CMD_UNKNOWN, data);
 	}
-	return new CmdCoords(data);
+	Command cmd(entry->type, data);
+	CMD_SPECS[entry->type].decode(cmd);
+	return cmd;
 }
 
-CmdBase* parseCmdCutMoveAbs(Data& data) {
-	if (data.size() != 11 || (data[0] != 0x88 && data[0] != 0xA8)) {
-		return new CmdUnknown(data);
-	}
-	return new CmdCutMoveAbs(data);
+void Command::calcStats(Stats& stats) const {
+	++(stats.*CMD_SPECS[type].counter);
 }
 
-CmdBase* parseCmdCutMoveRel(Data& data) {
-	if (data.size() != 5 || (data[0] != 0x89 && data[0] != 0xA9)) {
-		return new CmdUnknown(data);
-	}
-	return new CmdCutMoveRel(data);
+TERM_COLORS Command::getColor() const {
+	return CMD_SPECS[type].color;
 }
 
-CmdBase* parseCmdCutMoveRel1(Data& data) {
-	if (data.size() != 3
-			|| (data[0] != 0x8A && data[0] != 0x8B && data[0] != 0xAA
-					&& data[0] != 0xAB)) {
-		return new CmdUnknown(data);
-	}
-	return new CmdCutMoveRel1(data);
+string Command::getName() const {
+	return CMD_SPECS[type].name(*this);
 }
 
-CmdBase* parseCmdEnableDisable(Data& data) {
-	if (data.size() != 3 || data[0] != 0xCA || data[1] != 0x01) {
-		return new CmdUnknown(data);
-	}
-	return new CmdEnableDisable(data);
-}
-
-CmdBase* parseCmdSetColorLayer(Data& data) {
-  if (data.size() != 8 || data[0] != 0xCA || data[1] != 0x06) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetColorLayer(data);
-}
-
-CmdBase* parseCmdSetCurLayer(Data& data) {
-  if (data.size() != 3 || data[0] != 0xCA || data[1] != 0x02) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetCurLayer(data);
-}
-
-CmdBase* parseCmdSetMaxLayer(Data& data) {
-  if (data.size() != 3 || data[0] != 0xCA || data[1] != 0x22) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetMaxLayer(data);
-}
-
-CmdBase* parseCmdSetPwr(Data& data) {
-  if (data.size() != 4 || data[0] != 0xC6 ||
-      (data[1] != 0x01 && data[1] != 0x02 &&
-       data[1] != 0x21 && data[1] != 0x22)) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetPwr(data);
-}
-
-CmdBase* parseCmdSetPwrLayer(Data& data) {
-  if (data.size() != 5 || data[0] != 0xC6 ||
-      (data[1] != 0x31 && data[1] != 0x32 &&
-       data[1] != 0x41 && data[1] != 0x42)) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetPwrLayer(data);
-}
-
-CmdBase* parseCmdSetSpeed(Data& data) {
-  if (data.size() != 7 || data[0] != 0xC9 || data[1] != 0x02) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetSpeed(data);
-}
-
-CmdBase* parseCmdSetSpeedLayer(Data& data) {
-  if (data.size() != 8 || data[0] != 0xC9 || data[1] != 0x04) {
-    return new CmdUnknown(data);
-  }
-  return new CmdSetSpeedLayer(data);
-}
-
-CmdBase* parseCommand(Data& data) {
-  if (data.size() < 1) {
-    return new CmdEmpty(data);
-  }
-  if (data[0] < 0x80) {
-    return new CmdIncomplete(data);
-  }
-  switch (data[0]) {
-    case 0x88: return parseCmdCutMoveAbs(data);
-    case 0x89: return parseCmdCutMoveRel(data);
-    case 0x8A: return parseCmdCutMoveRel1(data);
-    case 0x8B: return parseCmdCutMoveRel1(data);
-    case 0xA8: return parseCmdCutMoveAbs(data);
-    case 0xA9: return parseCmdCutMoveRel(data);
-    case 0xAA: return parseCmdCutMoveRel1(data);
-    case 0xAB: return parseCmdCutMoveRel1(data);
-    case 0xC6:
-      if (data.size() >= 2) {
-        switch (data[1]) {
-          case 0x01:
-          case 0x02:
-          case 0x21:
-          case 0x22: return parseCmdSetPwr(data);
-          case 0x31:
-          case 0x32:
-          case 0x41:
-          case 0x42: return parseCmdSetPwrLayer(data);
-        }
-      }
-      break;
-    case 0xC9:
-      if (data.size() >= 2) {
-        switch (data[1]) {
-          case 0x02: return parseCmdSetSpeed(data);
-          case 0x04: return parseCmdSetSpeedLayer(data);
-        }
-      }
-      break;
-    case 0xCA:
-      if (data.size() >= 2) {
-        switch (data[1]) {
-          case 0x01: return parseCmdEnableDisable(data);
-          case 0x02: return parseCmdSetCurLayer(data);
-          case 0x06: return parseCmdSetColorLayer(data);
-          case 0x22: return parseCmdSetMaxLayer(data);
-        }
-      }
-      break;
-    case 0xE7:
-      if (data.size() >= 2) {
-        switch (data[1]) {
-          case 0x03:
-          case 0x07: return parseCmdCoords(data);
-        }
-      }
-      break;
-  }
-  return new CmdUnknown(data);
-}
-
-void VectorProcState::cut(const coord& x1, const coord& y1, const coord& x2,
-		const coord& y2) {
-  	if(vplot_.penPos != Point(x1, y1)) {
+ParamList Command::getParams(Arena& arena) const {
+	return CMD_SPECS[type].params(*this, arena);
+}
+
+void VectorProcState::cut(const icoord& x1, const icoord& y1, const icoord& x2,
+		const icoord& y2) {
+  	if(vplot_.penPos != IPoint(x1, y1)) {
 		if(vplot_.isPenDown())
 			vplot_.penUp();
 
@@ -605,3 +418,30 @@ void VectorProcState::cut(const coord& x1, const coord& y1, const coord& x2,
 
 	vplot_.move(x2, y2);
 }
+
+// the same pen logic as VectorPlotter::move, without a canvas
+void StatsProcState::cut(const icoord& x1, const icoord& y1, const icoord& x2,
+		const icoord& y2) {
+	IPoint from(x1, y1);
+	IPoint to(x2, y2);
+	if (penPos_ != from) {
+		if (down_) {
+			down_ = false;
+			Statistic::singleton()->announcePenUp(SLOT_VECTOR);
+		}
+		Statistic::singleton()->announceMove(penPos_.toPoint(), from.toPoint(), SLOT_VECTOR);
+		penPos_ = from;
+	}
+
+	if (!down_) {
+		down_ = true;
+		Statistic::singleton()->announcePenDown(SLOT_VECTOR);
+	}
+
+	if (penPos_ != to) {
+		Statistic::singleton()->announceWork(penPos_.toPoint(), to.toPoint(), SLOT_VECTOR);
+		penPos_ = to;
+	}
+	Point pos = penPos_.toPoint();
+	Trace::singleton()->logPlotterStat(pos);
+}
@@ -1,17 +1,59 @@
 #ifndef SRC_DECODE_HPP_
 #define SRC_DECODE_HPP_
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#include "2D.hpp"
+#include "Arena.hpp"
+#include "RdInstr.hpp"
 #include "Terminal.hpp"
 
 using namespace std;
-typedef std::vector<uint8_t> Data;
+typedef ByteView Data;
 
 string byteToHexString(const uint8_t& b);
 string makeFixedString(float var, int roundDigits);
-uint64_t parseUnsignedValue(const Data& data);
-int64_t parseSignedValue(const Data& data);
+
+inline uint64_t parseUnsignedValue(const Data& data) {
+	uint64_t value = 0;
+	for (auto& b : data) {
+		value *= 0x80;
+		value += b;
+	}
+	return value;
+}
+
+inline int64_t parseSignedValue(const Data& data) {
+	if (data.size() >= 1 && data[0] < 0x40) {
+		return parseUnsignedValue(data);
+	}
+	uint64_t valueInv = 0;
+	for (auto& b : data) {
+		valueInv *= 0x80;
+		valueInv += 0x7F ^ b;
+	}
+	return -(valueInv + 1);
+}
+
+// Fixed width variants of the above for the 1, 2 and 5 byte fields. They unroll to plain shifts.
+template<size_t N>
+constexpr uint64_t parseUnsigned(const uint8_t* p) {
+	return (parseUnsigned<N - 1>(p) << 7) + p[N - 1];
+}
+
+template<>
+constexpr uint64_t parseUnsigned<1>(const uint8_t* p) {
+	return p[0];
+}
+
+// the top bit of the N * 7 bit field is the sign
+template<size_t N>
+constexpr int64_t parseSigned(const uint8_t* p) {
+	return p[0] < 0x40 ?
+			int64_t(parseUnsigned<N>(p)) :
+			int64_t(parseUnsigned<N>(p)) - (int64_t(1) << (7 * N));
+}
 
 struct Param {
 	string name_;
@@ -25,6 +67,8 @@ struct Param {
 	}
 };
 
+typedef std::vector<Param, ArenaAllocator<Param>> ParamList;
+
 struct ParamPhys: public Param {
 	float scale_;
 	int roundDigits_;
@@ -61,44 +105,73 @@ struct Layer {
 	}
 };
 
-struct ProcState {
+// the x axis of the machine runs the other way than the one of the image. the bed is 1300 mm wide.
+struct BedTransform {
+	static constexpr icoord BED_WIDTH = 1300000;
+
+	static constexpr icoord x(int64_t x) {
+		return icoord(BED_WIDTH - x);
+	}
+	static constexpr icoord y(int64_t y) {
+		return icoord(y);
+	}
+	// relative moves are mirrored without the offset
+	static constexpr icoord dx(int64_t dx) {
+		return icoord(-dx);
+	}
+	static constexpr icoord dy(int64_t dy) {
+		return icoord(dy);
+	}
+};
+
+/*
+ * The machine state while interpreting a job. Positions are in micrometres on the bed. Sink is the concrete state and provides
+ * cut(); calls to it are resolved at compile time, so the motion commands inline into
+ * the interpreter loop. A sink may also hide setLimits().
+ */
+template<typename Sink>
+struct BasicProcState {
 	std::vector<Layer> layers;
 	int16_t layerNo = -1;
 	Layer layer;
-	coord maxX = 0;
-	coord maxY = 0;
-	coord minX = 0;
-	coord minY = 0;
+	icoord maxX = 0;
+	icoord maxY = 0;
+	icoord minX = 0;
+	icoord minY = 0;
 	dim pwr = 0;
 	dim speed = 0;
-	coord x = 1300;
-	coord y = 0;
+	icoord x = BedTransform::BED_WIDTH;
+	icoord y = 0;
 
-	ProcState() {
-	}
-	virtual ~ProcState() {
+	Sink& sink() {
+		return static_cast<Sink&>(*this);
 	}
 
-	virtual void cut(const coord& x1, const coord& y1, const coord& x2,
-			const coord& y2) = 0;
-	virtual void setLimits(const bool& isMax, const coord& x,
-			const coord& y) = 0;
+	// the arguments are the values of the instruction, in machine coordinates
+	void setLimits(const bool& isMax, const int64_t& x, const int64_t& y) {
+		if (isMax) {
+			maxX = BedTransform::x(x);
+			maxY = BedTransform::y(y);
+		} else {
+			minX = BedTransform::x(x);
+			minY = BedTransform::y(y);
+		}
+	}
 
-	void cutAbs(const coord& x, const coord& y) {
-		coord xs = 1300 - (x / 1000.0);
-		coord ys = y / 1000.0;
-		this->cut(this->x, this->y, xs, ys);
+	void cutAbs(const int64_t& x, const int64_t& y) {
+		icoord xs = BedTransform::x(x);
+		icoord ys = BedTransform::y(y);
+		sink().cut(this->x, this->y, xs, ys);
 		this->x = xs;
 		this->y = ys;
 	}
 
-	void cutRel(const coord& x, const coord& y) {
-		coord xs = 1300 - (x / 1000.0);
-		coord ys = y / 1000.0;
-
-		this->cut(this->x, this->y, this->x + xs, this->y + ys);
-		this->x += xs;
-		this->y += ys;
+	void cutRel(const int64_t& x, const int64_t& y) {
+		icoord xs = this->x + BedTransform::dx(x);
+		icoord ys = this->y + BedTransform::dy(y);
+		sink().cut(this->x, this->y, xs, ys);
+		this->x = xs;
+		this->y = ys;
 	}
 
 	Layer& getLayer(int16_t layerNo) {
@@ -111,14 +184,14 @@ struct ProcState {
 		return layers[layerNo];
 	}
 
-	void moveAbs(const coord& x, const coord& y) {
-		this->x = 1300 - (x / 1000.0);
-		this->y = y / 1000.0;
+	void moveAbs(const int64_t& x, const int64_t& y) {
+		this->x = BedTransform::x(x);
+		this->y = BedTransform::y(y);
 	}
 
-	void moveRel(const coord& x, const coord& y) {
-		this->x += 1300 - (x / 1000.0);
-		this->y += y / 1000.0;
+	void moveRel(const int64_t& x, const int64_t& y) {
+		this->x += BedTransform::dx(x);
+		this->y += BedTransform::dy(y);
 	}
 
 	void setLayerColor(int16_t layerNo, uint8_t red, uint8_t green,
@@ -150,67 +223,110 @@ struct ProcState {
 	}
 };
 
-class NullProcState: public ProcState {
+// tracks the state only
+class NullProcState: public BasicProcState<NullProcState> {
 public:
-	NullProcState() {
+	void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+			const icoord& y2) {
 	}
+};
 
-	virtual void cut(const coord& x1, const coord& y1, const coord& x2,
-			const coord& y2) override {
+// the bounding box of all cuts, in micrometres
+class BoundsProcState: public BasicProcState<BoundsProcState> {
+public:
+	IPoint cutMin;
+	IPoint cutMax;
+	bool hasCuts = false;
+
+	void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+			const icoord& y2) {
+		if (!hasCuts) {
+			cutMin = cutMax = IPoint(x1, y1);
+			hasCuts = true;
+		}
+		cutMin.x = std::min(cutMin.x, std::min(x1, x2));
+		cutMin.y = std::min(cutMin.y, std::min(y1, y2));
+		cutMax.x = std::max(cutMax.x, std::max(x1, x2));
+		cutMax.y = std::max(cutMax.y, std::max(y1, y2));
 	}
+};
 
-	virtual void setLimits(const bool& isMax, const coord& x, const coord& y)
-			override {
-		if (isMax) {
-			maxX = 1300 - (x / 1000.0);
-			maxY = y / 1000.0;
-		} else {
-			minX = 1300 - (x / 1000.0);
-			minY = y / 1000.0;
-		}
+// collects the statistics of the job without drawing anything
+class StatsProcState: public BasicProcState<StatsProcState> {
+	IPoint penPos_;
+	bool down_;
+public:
+	StatsProcState() :
+			penPos_(BedTransform::BED_WIDTH, 0), down_(false) {
 	}
+
+	void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+			const icoord& y2);
 };
 
 class VectorPlotter;
-class VectorProcState: public ProcState {
+class VectorProcState: public BasicProcState<VectorProcState> {
 	VectorPlotter& vplot_;
 public:
 	VectorProcState(VectorPlotter& vplot) :
 			vplot_(vplot) {
 	}
 
-	virtual void cut(const coord& x1, const coord& y1, const coord& x2,
-			const coord& y2) override;
+	void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+			const icoord& y2);
+};
 
-	virtual void setLimits(const bool& isMax, const coord& x, const coord& y)
-			override {
-		if (isMax) {
-			maxX = 1300 - (x / 1000.0);
-			maxY = y / 1000.0;
-		} else {
-			minX = 1300 - (x / 1000.0);
-			minY = y / 1000.0;
-		}
-	}
+enum CMD_TYPE {
+	CMD_EMPTY,
+	CMD_INCOMPLETE,
+	CMD_UNKNOWN,
+	CMD_COORDS,
+	CMD_CUT_MOVE_ABS,
+	CMD_CUT_MOVE_REL,
+	CMD_CUT_MOVE_REL1,
+	CMD_ENABLE_DISABLE,
+	CMD_SET_COLOR_LAYER,
+	CMD_SET_CUR_LAYER,
+	CMD_SET_MAX_LAYER,
+	CMD_SET_PWR,
+	CMD_SET_PWR_LAYER,
+	CMD_SET_SPEED,
+	CMD_SET_SPEED_LAYER
 };
 
-struct CmdBase {
+/*
+ * A decoded command. It is a plain value keyed by its type, only the fields
+ * of that type are meaningful. data is a view of the instruction bytes.
+ */
+struct Command {
+	CMD_TYPE type;
 	Data data;
-	CmdBase(Data& data) :
-			data(data) {
-	}
-	virtual ~CmdBase() {
+	bool isMax;      // coords, power
+	bool isCut;      // moves
+	bool isY;        // relative move in one direction
+	int16_t laserNo; // power
+	int16_t layer;   // layer settings
+	int64_t x;       // coords, moves. micrometres, as in the instruction
+	int64_t y;       // coords, moves
+	dim value;       // devices, color, power or speed
+
+	Command(CMD_TYPE type, const Data& data) :
+			type(type), data(data), isMax(false), isCut(false), isY(false), laserNo(
+					0), layer(0), x(0), y(0), value(0) {
 	}
 
-	virtual void process(ProcState& procState) = 0;
-	virtual void calcStats(Stats& stats) = 0;
-	virtual TERM_COLORS getColor() = 0;
-	virtual string getName() = 0;
-	virtual std::vector<Param> getParams() = 0;
+	// the state is a BasicProcState. resolved at compile time, see below.
+	template<typename State>
+	void process(State& procState) const;
+	void calcStats(Stats& stats) const;
+	TERM_COLORS getColor() const;
+	string getName() const;
+	// the parameter list is allocated in the given arena
+	ParamList getParams(Arena& arena) const;
 
-	virtual string toString() {
+	string toString(Arena& arena) const {
 		auto cmdStr = getName();
-		auto params = getParams();
+		auto params = getParams(arena);
 		string sep = ": ";
 		stringstream ss;
 		ss << cmdStr;
@@ -222,7 +338,53 @@ struct CmdBase {
 	}
 };
 
-CmdBase* parseCommand(Data& data);
+Command parseCommand(const Data& data);
+
+template<typename State>
+inline void Command::process(State& procState) const {
+	switch (type) {
+	case CMD_COORDS:
+		procState.setLimits(isMax, x, y);
+		break;
+	case CMD_CUT_MOVE_ABS:
+		if (isCut)
+			procState.cutAbs(x, y);
+		else
+			procState.moveAbs(x, y);
+		break;
+	case CMD_CUT_MOVE_REL:
+	case CMD_CUT_MOVE_REL1:
+		if (isCut)
+			procState.cutRel(x, y);
+		else
+			procState.moveRel(x, y);
+		break;
+	case CMD_SET_COLOR_LAYER:
+		procState.setLayerColor(layer, value & 0xFF, value >> 8 & 0xFF,
+				value >> 16 & 0xFF);
+		break;
+	case CMD_SET_CUR_LAYER:
+		procState.setCurLayer(layer);
+		break;
+	case CMD_SET_MAX_LAYER:
+		procState.setMaxLayer(layer);
+		break;
+	case CMD_SET_PWR:
+		procState.setPwr(value);
+		break;
+	case CMD_SET_PWR_LAYER:
+		procState.setLayerPwr(layer, value);
+		break;
+	case CMD_SET_SPEED:
+		procState.setSpeed(value);
+		break;
+	case CMD_SET_SPEED_LAYER:
+		procState.setLayerSpeed(layer, value);
+		break;
+	default:
+		break;
+	}
+}
 
 
 #endif /* SRC_DECODE_HPP_ */
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+#include "Geometry.hpp"
+
+static_assert(sizeof(GeoVertex) == 8, "GeoVertex is written as is");
+static_assert(sizeof(GeoPolyline) == 16, "GeoPolyline is written as is");
+
+constexpr char Geometry::MAGIC[8];
+
+GeoLayer& Geometry::layer(int16_t layerNo) {
+	for (auto& l : layers_) {
+		if (l.layerNo == layerNo)
+			return l;
+	}
+	layers_.push_back(GeoLayer(layerNo));
+	return layers_.back();
+}
+
+bool Geometry::isGeometryFile(const char* filename) {
+	const char* ext = strrchr(filename, '.');
+	return ext != NULL && strcasecmp(ext, ".geo") == 0;
+}
+
+void Geometry::addCut(int16_t layerNo, uint32_t speed, uint32_t power,
+		const GeoVertex& from, const GeoVertex& to) {
+	if (current_ >= layers_.size() || layers_[current_].layerNo != layerNo)
+		current_ = &layer(layerNo) - layers_.data();
+	GeoLayer& l = layers_[current_];
+
+	std::vector<GeoPolyline>& polylines = l.polylines;
+	if (polylines.empty() || polylines.back().speed != speed
+			|| polylines.back().power != power || !(l.vertices.back() == from)) {
+		polylines.push_back( { speed, power, uint32_t(l.vertices.size()), 1 });
+		l.vertices.push_back(from);
+	}
+	l.vertices.push_back(to);
+	++polylines.back().count;
+}
+
+template<typename T>
+static void writeRaw(std::ostream& os, const T& v) {
+	os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T>
+static void writeRaw(std::ostream& os, const std::vector<T>& v) {
+	writeRaw(os, uint32_t(v.size()));
+	os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+}
+
+template<typename T>
+static bool readRaw(std::istream& is, T& v) {
+	return bool(is.read(reinterpret_cast<char*>(&v), sizeof(T)));
+}
+
+// bytes left in the stream, -1 if it can't seek
+static std::streamoff bytesLeft(std::istream& is) {
+	std::streampos pos = is.tellg();
+	if (pos == std::streampos(-1) || !is.seekg(0, std::ios::end))
+		return -1;
+	std::streamoff left = is.tellg() - pos;
+	is.seekg(pos);
+	return left;
+}
+
+// the count is checked against the bytes left, so a corrupt one can't allocate more than the file
+// holds. streams which can't seek are read a piece at a time instead.
+template<typename T>
+static bool readRaw(std::istream& is, std::vector<T>& v) {
+	static constexpr uint32_t PIECE = (1 << 20) / sizeof(T);
+	uint32_t size;
+	if (!readRaw(is, size))
+		return false;
+	std::streamoff left = bytesLeft(is);
+	if (!is || (left >= 0 && std::streamoff(size) * std::streamoff(sizeof(T)) > left))
+		return false;
+
+	v.clear();
+	while (v.size() < size) {
+		size_t done = v.size();
+		v.resize(done + std::min(size - done, size_t(PIECE)));
+		if (!is.read(reinterpret_cast<char*>(v.data() + done), (v.size() - done) * sizeof(T)))
+			return false;
+	}
+	return true;
+}
+
+void Geometry::save(std::ostream& os) const {
+	os.write(MAGIC, sizeof(MAGIC));
+	writeRaw(os, maxX_);
+	writeRaw(os, maxY_);
+	writeRaw(os, uint32_t(layers_.size()));
+	for (auto& l : layers_) {
+		writeRaw(os, l.layerNo);
+		writeRaw(os, l.polylines);
+		writeRaw(os, l.vertices);
+	}
+}
+
+bool Geometry::load(std::istream& is) {
+	char magic[sizeof(MAGIC)];
+	uint32_t numLayers;
+	if (!is.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+			|| !readRaw(is, maxX_) || !readRaw(is, maxY_) || !readRaw(is, numLayers))
+		return false;
+
+	layers_.clear();
+	for (uint32_t i = 0; i < numLayers; ++i) {
+		int16_t layerNo;
+		if (!readRaw(is, layerNo))
+			return false;
+		layers_.push_back(GeoLayer(layerNo));
+		GeoLayer& l = layers_.back();
+		if (!readRaw(is, l.polylines) || !readRaw(is, l.vertices))
+			return false;
+		for (auto& p : l.polylines) {
+			if (p.count < 2 || p.first > l.vertices.size()
+					|| p.count > l.vertices.size() - p.first)
+				return false;
+		}
+	}
+	return true;
+}
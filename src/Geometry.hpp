@@ -0,0 +1,125 @@
+#ifndef SRC_GEOMETRY_HPP_
+#define SRC_GEOMETRY_HPP_
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "2D.hpp"
+#include "Decode.hpp"
+
+// a vertex in micrometres
+struct GeoVertex {
+	icoord x;
+	icoord y;
+
+	bool operator==(const GeoVertex& other) const {
+		return x == other.x && y == other.y;
+	}
+};
+
+// vertices [first, first + count) of the layer, cut at the given speed and power
+struct GeoPolyline {
+	uint32_t speed;
+	uint32_t power;
+	uint32_t first;
+	uint32_t count;
+};
+
+struct GeoLayer {
+	int16_t layerNo;
+	std::vector<GeoPolyline> polylines;
+	std::vector<GeoVertex> vertices;
+
+	GeoLayer(int16_t layerNo) :
+			layerNo(layerNo), polylines(), vertices() {
+	}
+};
+
+/*
+ * The cuts of a job as per layer polylines. Recorded while the job is interpreted, so the
+ * consumers don't have to decode the job again. Can be cached on disk and rendered from there.
+ */
+class Geometry {
+private:
+	static constexpr char MAGIC[8] = { 'R', 'D', 'G', 'E', 'O', 'M', '\0', '\2' };
+	// the bed size, as the limits of the job
+	icoord maxX_;
+	icoord maxY_;
+	std::vector<GeoLayer> layers_;
+	// the layer cut last
+	size_t current_;
+
+public:
+	Geometry() :
+			maxX_(0), maxY_(0), layers_(), current_(0) {
+	}
+
+	// cached geometries are recognized by the extension .geo
+	static bool isGeometryFile(const char* filename);
+
+	const std::vector<GeoLayer>& layers() const {
+		return layers_;
+	}
+
+	icoord maxX() const {
+		return maxX_;
+	}
+
+	icoord maxY() const {
+		return maxY_;
+	}
+
+	void setLimits(icoord maxX, icoord maxY) {
+		maxX_ = maxX;
+		maxY_ = maxY;
+	}
+
+	// the layer with the given number. created on first use.
+	GeoLayer& layer(int16_t layerNo);
+
+	// continues the last polyline of the layer if the cut connects and nothing changed
+	void addCut(int16_t layerNo, uint32_t speed, uint32_t power, const GeoVertex& from,
+			const GeoVertex& to);
+
+	// cuts every segment into procState, layer by layer
+	template<typename State>
+	void replay(State& procState) const {
+		for (auto& l : layers_) {
+			procState.layerNo = l.layerNo;
+			for (auto& p : l.polylines) {
+				procState.speed = p.speed;
+				procState.pwr = p.power;
+				for (uint32_t i = p.first + 1; i < p.first + p.count; ++i) {
+					const GeoVertex& from = l.vertices[i - 1];
+					const GeoVertex& to = l.vertices[i];
+					procState.cut(from.x, from.y, to.x, to.y);
+				}
+			}
+		}
+	}
+
+	// raw records in host byte order behind a magic and version
+	void save(std::ostream& os) const;
+	bool load(std::istream& is);
+};
+
+// hands the cuts on to Sink and records them into the geometry on the way
+template<typename Sink>
+class GeometryProcState: public BasicProcState<GeometryProcState<Sink>> {
+	Sink& sink_;
+	Geometry& geometry_;
+
+public:
+	GeometryProcState(Sink& sink, Geometry& geometry) :
+			sink_(sink), geometry_(geometry) {
+	}
+
+	void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+			const icoord& y2) {
+		sink_.cut(x1, y1, x2, y2);
+		geometry_.addCut(this->layerNo, uint32_t(this->speed), uint32_t(this->pwr),
+				{ x1, y1 }, { x2, y2 });
+	}
+};
+
+#endif /* SRC_GEOMETRY_HPP_ */
@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+#include <png.h>
+#include "ImageWriter.hpp"
+
+// binary PBM (P4) or PGM (P5)
+class PnmWriter: public ImageWriter {
+	FILE* file_;
+	bool gray_;
+	std::vector<uint8_t> grayRow_;
+
+public:
+	PnmWriter(FILE* file, bool gray, int width, int height) :
+			ImageWriter(width, height), file_(file), gray_(gray), grayRow_() {
+		if (gray_) {
+			std::fprintf(file_, "P5\n%d %d\n255\n", width_, height_);
+			grayRow_.resize(width_);
+		} else {
+			std::fprintf(file_, "P4\n%d %d\n", width_, height_);
+		}
+	}
+
+	virtual ~PnmWriter() {
+		if (file_ != NULL)
+			std::fclose(file_);
+	}
+
+	virtual void writeRow(const uint8_t* row) {
+		if (!gray_) {
+			std::fwrite(row, 1, rowBytes(), file_);
+			return;
+		}
+		for (int x = 0; x < width_; ++x)
+			grayRow_[x] = (row[x / 8] >> (7 - x % 8)) & 1 ? 0 : 255;
+		std::fwrite(grayRow_.data(), 1, grayRow_.size(), file_);
+	}
+
+	virtual void flush() {
+		std::fflush(file_);
+	}
+
+	virtual bool close() {
+		bool good = !std::ferror(file_);
+		good = std::fclose(file_) == 0 && good;
+		file_ = NULL;
+		return good;
+	}
+};
+
+// 1-bit grayscale PNG. libpng reports errors by a longjmp back into the call.
+class PngWriter: public ImageWriter {
+	FILE* file_;
+	png_structp png_;
+	png_infop info_;
+	bool failed_;
+	std::vector<uint8_t> pngRow_;
+
+public:
+	PngWriter(FILE* file, int width, int height) :
+			ImageWriter(width, height), file_(file), png_(NULL), info_(NULL), failed_(false),
+					pngRow_(rowBytes()) {
+		png_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		if (png_ != NULL)
+			info_ = png_create_info_struct(png_);
+		if (info_ == NULL || setjmp(png_jmpbuf(png_))) {
+			failed_ = true;
+			return;
+		}
+		png_init_io(png_, file_);
+		png_set_IHDR(png_, info_, width_, height_, 1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+				PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_write_info(png_, info_);
+	}
+
+	virtual ~PngWriter() {
+		png_destroy_write_struct(&png_, &info_);
+		if (file_ != NULL)
+			std::fclose(file_);
+	}
+
+	virtual void writeRow(const uint8_t* row) {
+		if (failed_ || setjmp(png_jmpbuf(png_))) {
+			failed_ = true;
+			return;
+		}
+		// in a gray PNG set bits are white
+		for (size_t i = 0; i < pngRow_.size(); ++i)
+			pngRow_[i] = ~row[i];
+		png_write_row(png_, pngRow_.data());
+	}
+
+	virtual void flush() {
+		if (failed_ || setjmp(png_jmpbuf(png_))) {
+			failed_ = true;
+			return;
+		}
+		png_write_flush(png_);
+	}
+
+	virtual bool close() {
+		if (!failed_ && !setjmp(png_jmpbuf(png_)))
+			png_write_end(png_, NULL);
+		else
+			failed_ = true;
+		bool good = !failed_ && !std::ferror(file_);
+		good = std::fclose(file_) == 0 && good;
+		file_ = NULL;
+		return good;
+	}
+};
+
+static bool hasExtension(const std::string& filename, const char* ext) {
+	const char* dot = strrchr(filename.c_str(), '.');
+	return dot != NULL && strcasecmp(dot + 1, ext) == 0;
+}
+
+bool ImageWriter::isSupported(const std::string& filename) {
+	return hasExtension(filename, "pbm") || hasExtension(filename, "pgm")
+			|| hasExtension(filename, "png");
+}
+
+ImageWriter* ImageWriter::open(const std::string& filename, int width, int height) {
+	FILE* file = std::fopen(filename.c_str(), "wb");
+	if (file == NULL)
+		return NULL;
+	if (hasExtension(filename, "png"))
+		return new PngWriter(file, width, height);
+	return new PnmWriter(file, hasExtension(filename, "pgm"), width, height);
+}
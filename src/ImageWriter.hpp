@@ -0,0 +1,44 @@
+#ifndef SRC_IMAGEWRITER_HPP_
+#define SRC_IMAGEWRITER_HPP_
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Encodes a monochrome image row by row, top to bottom, so the encoded image never has to be in memory
+ * as a whole. Whether the pixels have to be is up to the caller, see Canvas::writeRows().
+ * Rows are packed like in a PBM: 8 pixels per byte, the first one in the highest bit, set bits are black.
+ */
+class ImageWriter {
+protected:
+	const int width_;
+	const int height_;
+
+public:
+	ImageWriter(int width, int height) :
+			width_(width), height_(height) {
+	}
+
+	virtual ~ImageWriter() {
+	}
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// PBM, PGM and PNG files, by the extension of the filename
+	static bool isSupported(const std::string& filename);
+	// NULL if the file can't be created
+	static ImageWriter* open(const std::string& filename, int width, int height);
+
+	size_t rowBytes() const {
+		return (width_ + 7) / 8;
+	}
+
+	virtual void writeRow(const uint8_t* row) = 0;
+	// hands the rows written so far on to the file
+	virtual void flush() = 0;
+	// writes what is left. false if anything went wrong.
+	virtual bool close() = 0;
+};
+
+#endif /* SRC_IMAGEWRITER_HPP_ */
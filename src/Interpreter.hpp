@@ -2,6 +2,11 @@
 #define INTERPRETER_H_
 
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <thread>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -10,75 +15,408 @@
 #include "Config.hpp"
 #include "Plotter.hpp"
 #include "Decode.hpp"
+#include "Geometry.hpp"
 #include "RdInstr.hpp"
 #include "RdPlot.hpp"
+#include "SpscRing.hpp"
+#include "ThreadPool.hpp"
 
 using std::string;
 using std::stringstream;
 
 class Interpreter {
 private:
-	RdInstr* nextRdInstr(RdPlot* rdPlot, const char* expected = NULL) {
-		RdInstr* instr = rdPlot->expectInstr(expected);
+	typedef std::vector<Command, ArenaAllocator<Command>> CommandList;
+	typedef std::vector<RdInstr, ArenaAllocator<RdInstr>> InstrList;
+
+	// formatting of a single instruction. reset after every instruction.
+	Arena scratch;
+	bool tracing;
+	size_t numInstructions;
+	double runTime;
+	// raised by the signal handler. every loop and pipeline stage returns after its current item.
+	inline static std::atomic<bool> stopRequested;
+
+	const RdInstr* nextRdInstr(RdPlot* rdPlot, const char* expected = NULL) {
+		const RdInstr* instr = rdPlot->expectInstr(expected);
 		Debugger::getInstance()->announce(instr);
 		return instr;
 	}
 
+	static constexpr size_t DECODE_BATCH_SIZE = 1 << 16;
+
+	// how many items of itemBytes each are read ahead in a batch or a ring, up to max.
+	// two are in flight, with a memory budget both have to fit into its share for decoding.
+	static size_t aheadSize(size_t max, size_t itemBytes) {
+		size_t budget = Config::singleton()->decodeBudget();
+		if (budget == 0)
+			return max;
+		return std::bit_floor(std::clamp(budget / (2 * itemBytes), size_t(64), max));
+	}
+
+	static size_t batchSize() {
+		return aheadSize(DECODE_BATCH_SIZE, sizeof(Command) + sizeof(RdInstr));
+	}
+
+	// decodes the instructions into cmds, in file order
+	void decodeParallel(ThreadPool& pool, const std::vector<RdInstr>& instrs, CommandList& cmds) {
+		cmds.assign(instrs.size(), Command(CMD_EMPTY, Data()));
+		// a few chunks per thread to even out the load
+		size_t numChunks = pool.size() * 4;
+		size_t chunkSize = (cmds.size() + numChunks - 1) / numChunks;
+		pool.run(numChunks, [&](size_t chunk) {
+			size_t chunkEnd = std::min(cmds.size(), (chunk + 1) * chunkSize);
+			for (size_t i = chunk * chunkSize; i < chunkEnd; ++i) {
+				cmds[i] = parseCommand(instrs[i].data);
+			}
+		});
+	}
+
+	// the file offset right behind the last instruction of the batch
+	static off64_t batchEnd(const std::vector<RdInstr>& instrs) {
+		return instrs.back().file_off + instrs.back().data.size();
+	}
+
+	// reads and decodes a batch at a time, so memory doesn't grow with the size of the job.
+	// the next batch is read and decoded on the pool while the calling thread applies the current
+	// one, the instructions of a batch are released once it is applied.
+	template<typename State>
+	void applyDecoded(RdPlot* rdPlot, State& procState) {
+		// the calling thread is busy applying, the decoding thread takes its place in the pool
+		ThreadPool pool(std::max(1u, Config::singleton()->jobs - 1));
+		std::vector<RdInstr> instrs[2];
+		CommandList batches[2] = { CommandList(rdPlot->getArena()), CommandList(rdPlot->getArena()) };
+		auto readDecoded = [&](size_t b) {
+			rdPlot->readBatch(instrs[b], batchSize());
+			decodeParallel(pool, instrs[b], batches[b]);
+		};
+
+		rdPlot->hold(true);
+		readDecoded(0);
+		for (size_t b = 0; !instrs[b % 2].empty() && !stopRequested; ++b) {
+			std::thread decoder(readDecoded, (b + 1) % 2);
+			const std::vector<RdInstr>& batch = instrs[b % 2];
+			const CommandList& cmds = batches[b % 2];
+			for (size_t i = 0; i < batch.size() && !stopRequested; ++i) {
+				RdInstr instr = batch[i];
+				Trace::singleton()->logInstr(&instr);
+				applyCommand(&instr, cmds[i], procState);
+			}
+			decoder.join();
+			rdPlot->release(batchEnd(batch));
+		}
+		rdPlot->hold(false);
+	}
+
+	// reads the whole job a batch at a time and starts over at the beginning after it
+	template<typename Visit>
+	void prescan(RdPlot* rdPlot, Visit visit) {
+		std::vector<RdInstr> instrs;
+		rdPlot->hold(true);
+		for (rdPlot->readBatch(instrs, batchSize()); !instrs.empty() && !stopRequested;
+				rdPlot->readBatch(instrs, batchSize())) {
+			for (const RdInstr& instr : instrs)
+				visit(instr);
+			rdPlot->release(batchEnd(instrs));
+		}
+		rdPlot->hold(false);
+		rdPlot->rewind();
+	}
+
+	// the bed size is given by the last maximum coordinates (E7 07) of the job.
+	// a file is read for them before rendering, so the job can be rendered in a single pass.
+	bool prescanLimits(RdPlot* rdPlot, NullProcState& limits) {
+		size_t count = 0;
+		prescan(rdPlot, [&](const RdInstr& instr) {
+			++count;
+			if (instr.data[0] != 0xE7)
+				return;
+			Command cmd = parseCommand(instr.data);
+			if (cmd.type == CMD_COORDS && cmd.isMax)
+				cmd.process(limits);
+		});
+		if (!rdPlot->isValid() || count == 0) {
+			rdPlot->invalidate("End of file reached without any absolute moves(?)");
+			return false;
+		}
+		return true;
+	}
+
+	// streamed input can't be read twice. it is read up to the first maximum coordinates,
+	// which are in the header of a job, and copies of the instructions read on the way are kept
+	// to be interpreted first. unlike in a file, later maximum coordinates don't change the bed size.
+	bool readLimits(RdPlot* rdPlot, NullProcState& limits, InstrList& header) {
+		RdInstr* rdInstr = nullptr;
+		while (rdPlot->good() && (rdInstr = rdPlot->expectInstr())) {
+			header.push_back(rdPlot->copy(*rdInstr));
+			Command cmd = parseCommand(rdInstr->data);
+			if (cmd.type == CMD_COORDS && cmd.isMax) {
+				cmd.process(limits);
+				return true;
+			}
+		}
+		if (header.empty()) {
+			rdPlot->invalidate("End of file reached without any absolute moves(?)");
+			return false;
+		}
+		return true;
+	}
+
+	// decodes the whole job without drawing, for the extent of the cuts
+	void prescanBounds(RdPlot* rdPlot, BoundsProcState& bounds) {
+		prescan(rdPlot, [&](const RdInstr& instr) {
+			parseCommand(instr.data).process(bounds);
+		});
+	}
+
+	static constexpr size_t PIPELINE_RING_SIZE = 1 << 12;
+
+	// a cut with the state it is made in
+	struct Segment {
+		icoord x1, y1, x2, y2;
+		int16_t layerNo;
+		dim pwr;
+		dim speed;
+	};
+
+	// the decoder stage of the pipeline: hands the cuts on to the renderer
+	class SegmentProcState: public BasicProcState<SegmentProcState> {
+		SpscRing<Segment>& ring_;
+	public:
+		SegmentProcState(SpscRing<Segment>& ring) :
+				ring_(ring) {
+		}
+
+		void cut(const icoord& x1, const icoord& y1, const icoord& x2,
+				const icoord& y2) {
+			ring_.push( { x1, y1, x2, y2, layerNo, pwr, speed }, stopRequested);
+		}
+	};
+
+	// reading, decoding and rasterizing overlap on three threads connected by bounded rings.
+	// for streamed input, where the reader waits for the input. the renderer is the calling thread.
+	// the instructions in the ring are held, the decoder releases them once they are decoded.
+	template<typename Sink>
+	void runPipeline(RdPlot* rdPlot, const InstrList& header, Sink& sink) {
+		size_t ringSize = aheadSize(PIPELINE_RING_SIZE, sizeof(RdInstr) + sizeof(Segment));
+		SpscRing<RdInstr> instrs(ringSize);
+		SpscRing<Segment> segments(ringSize);
+		size_t decoded = 0;
+
+		rdPlot->hold(true);
+		std::thread reader([&] {
+			bool pushed = true;
+			for (size_t i = 0; i < header.size() && pushed; ++i)
+				pushed = instrs.push(header[i], stopRequested);
+			RdInstr* rdInstr = nullptr;
+			while (pushed && rdPlot->good() && (rdInstr = rdPlot->expectInstr())
+					&& instrs.push(*rdInstr, stopRequested))
+				;
+			instrs.close();
+		});
+		std::thread decoder([&] {
+			SegmentProcState segPs(segments);
+			RdInstr instr;
+			while (instrs.pop(instr, stopRequested)) {
+				parseCommand(instr.data).process(segPs);
+				rdPlot->release(instr.file_off + instr.data.size());
+				++decoded;
+			}
+			segments.close();
+		});
+
+		Segment seg;
+		while (segments.pop(seg, stopRequested)) {
+			sink.layerNo = seg.layerNo;
+			sink.pwr = seg.pwr;
+			sink.speed = seg.speed;
+			sink.cut(seg.x1, seg.y1, seg.x2, seg.y2);
+		}
+
+		reader.join();
+		decoder.join();
+		rdPlot->hold(false);
+		numInstructions += decoded;
+	}
+
+	// without an image, a window or the debugger the statistics are all there is to compute
+	bool needsCanvas() const {
+		Config* config = Config::singleton();
+		return config->vectorFilename != NULL || config->screenSize != NULL
+				|| config->interactive;
+	}
+
+	// runs the job into procState, and into the geometry on the way if it is recorded
+	template<typename State, typename Run>
+	void withGeometry(State& procState, Run run) {
+		if (this->geometry == nullptr) {
+			run(procState);
+		} else {
+			GeometryProcState<State> geoPs(procState, *this->geometry);
+			run(geoPs);
+		}
+	}
+
+	// only the part of the bed with the cuts is allocated if they were prescanned.
+	// false if the canvas can't be set up, e.g. within the memory budget.
+	bool createPlotter(dim width, dim height, const BoundsProcState& bounds) {
+		BoundingBox cutBounds;
+		if (bounds.hasCuts)
+			cutBounds = BoundingBox(bounds.cutMin.toPoint(), bounds.cutMax.toPoint());
+		this->vectorPlotter = new VectorPlotter(width, height,
+				Config::singleton()->clip, bounds.hasCuts ? &cutBounds : NULL);
+		return this->vectorPlotter->getCanvas()->isValid();
+	}
+
+	// the loop is instantiated for every kind of state, so the commands inline into it.
+	// with more than one thread the work is spread out: a file is decoded in parallel
+	// batches, ahead of applying them. streamed input goes through the pipeline, unless every
+	// instruction is traced in order. the interactive debugger has to step through the stream.
+	// the header holds the instructions already read from streamed input, they come first.
+	template<typename State>
+	void interpret(RdPlot* rdPlot, const InstrList& header, State& procState, bool interactive) {
+		if (!interactive && Config::singleton()->jobs > 1) {
+			if (rdPlot->isSeekable()) {
+				applyDecoded(rdPlot, procState);
+				return;
+			}
+			if (!tracing) {
+				runPipeline(rdPlot, header, procState);
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < header.size() && !stopRequested; ++i)
+			applyCommand(&header[i], procState);
+		RdInstr* rdInstr = nullptr;
+		while (!stopRequested && rdPlot->good() && (rdInstr = rdPlot->expectInstr())) {
+			applyCommand(rdInstr, procState);
+		}
+	}
+
 public:
 	VectorPlotter* vectorPlotter = nullptr;
+	// recorded while running, if set
+	Geometry* geometry = nullptr;
 //  BitmapPlotter* bitmapPlotter = nullptr;
 
-	Interpreter() {
+	// the instruction trace is only written in debug level or for the interactive debugger
+	Interpreter() :
+			tracing(Config::singleton()->debugLevel >= LVL_DEBUG || Config::singleton()->interactive),
+			numInstructions(0), runTime(0) {
 //    this->bitmapPlotter = new BitmapPlotter(plot->getWidth()/8, plot->getHeight(), Config::singleton()->clip);
 	}
 	;
 
-	void applyCommand(RdInstr* rdInstr, ProcState* procState, bool print = true) {
+	template<typename State>
+	void applyCommand(const RdInstr* rdInstr, State& procState) {
+		applyCommand(rdInstr, parseCommand(rdInstr->data), procState);
+	}
+
+	template<typename State>
+	void applyCommand(const RdInstr* rdInstr, const Command& cmd, State& procState) {
+		++numInstructions;
+
+		// nobody is reading the trace: no formatting at all
+		if (!tracing) {
+			cmd.process(procState);
+			return;
+		}
+
 		if(Debugger::getInstance())
 			Debugger::getInstance()->announce(rdInstr);
-		if (print && (Config::singleton()->debugLevel >= LVL_DEBUG
-				|| Config::singleton()->interactive)) {
-			cerr << std::dec << "[" << procState->x << ',' << procState->y << "] " << *rdInstr << " ->";
-			for (auto& c : rdInstr->data) {
-				cerr << " " << std::hex << std::setfill('0')
-				<< std::setw(2) << (int) c;
-			}
-			cerr << endl;
+		cerr << std::dec << "[" << procState.x / 1000.0 << ',' << procState.y / 1000.0 << "] " << *rdInstr << " ->";
+		for (auto& c : rdInstr->data) {
+			cerr << " " << std::hex << std::setfill('0')
+			<< std::setw(2) << (int) c;
 		}
+		cerr << endl;
+		std::cerr << "  " << make_color(cmd.toString(scratch), cmd.getColor()) << std::endl << "> ";
+		scratch.reset();
+		cmd.process(procState);
+	}
 
-		CmdBase* cmd = parseCommand(rdInstr->data);
-		if(print)
-			std::cerr << "  " << make_color(cmd->toString(), cmd->getColor()) << std::endl << "> ";
-		cmd->process(*procState);
+	// async signal safe
+	static void stop() {
+		stopRequested = true;
+	}
+
+	static bool stopped() {
+		return stopRequested;
+	}
+
+	void printStats(ostream& os) const {
+		os << "INTERP\t| instructions=" << numInstructions << endl;
+		os << "INTERP\t| run time=" << runTime << "s" << endl;
+		os << "INTERP\t| instructions/s=" << (runTime > 0 ? numInstructions / runTime : 0) << endl;
 	}
 
 	void run(RdPlot *rdPlot, bool interactive) {
-		RdInstr* rdInstr = nullptr;
-		NullProcState nullPs;
-		std::vector<RdInstr> header;
-		while (rdPlot->good() && (rdInstr = rdPlot->expectInstr()) != nullptr) {
-			header.push_back(*rdInstr);
-			applyCommand(rdInstr, &nullPs, false);
-		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		runPlot(rdPlot, interactive);
+		runTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
 
-		if (rdInstr == nullptr) {
-			rdPlot->invalidate("End of file reached without any absolute moves(?)");
+	void run(const Geometry& cached) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		runGeometry(cached);
+		runTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// renders a geometry recorded before instead of an RD-file. the cuts come layer by layer,
+	// so the moves in the statistics follow that order.
+	void runGeometry(const Geometry& cached) {
+		Debugger::create();
+		dim width = cached.maxX() / 1000;
+		dim height = cached.maxY() / 1000;
+		Statistic::init(width, height, 25.4);
+		if (this->geometry != nullptr)
+			this->geometry->setLimits(cached.maxX(), cached.maxY());
+		if (needsCanvas()) {
+			BoundsProcState bounds;
+			if (Config::singleton()->prescanMargin >= 0)
+				cached.replay(bounds);
+			if (!createPlotter(width, height, bounds))
+				return;
+			VectorProcState vecPs(*this->vectorPlotter);
+			withGeometry(vecPs, [&](auto& procState) { cached.replay(procState); });
 		} else {
+			StatsProcState statsPs;
+			withGeometry(statsPs, [&](auto& procState) { cached.replay(procState); });
+		}
+	}
+
+	void runPlot(RdPlot *rdPlot, bool interactive) {
+		NullProcState limits;
+		InstrList header(rdPlot->getArena());
+		if (rdPlot->isSeekable() ? prescanLimits(rdPlot, limits) : readLimits(rdPlot, limits, header)) {
 		  if (interactive) {
 			Debugger::create(vectorPlotter);
 			Debugger::getInstance()->setInteractive(true);
 		  } else {
 			Debugger::create();
 		  }
-			Statistic::init(nullPs.maxX, nullPs.maxY, 25.4);
-			this->vectorPlotter = new VectorPlotter(nullPs.maxX, nullPs.maxY,
-					Config::singleton()->clip);
-			VectorProcState vecPs(*this->vectorPlotter);
-			for(auto& instr : header) {
-				applyCommand(&instr, &vecPs);
-			}
-			while (rdPlot->good() && (rdInstr = rdPlot->expectInstr())) {
-				applyCommand(rdInstr, &vecPs);
+			// the bed size in whole millimetres
+			dim width = limits.maxX / 1000;
+			dim height = limits.maxY / 1000;
+			Statistic::init(width, height, 25.4);
+			if (this->geometry != nullptr)
+				this->geometry->setLimits(limits.maxX, limits.maxY);
+			if (needsCanvas()) {
+				BoundsProcState bounds;
+				if (Config::singleton()->prescanMargin >= 0)
+					prescanBounds(rdPlot, bounds);
+				if (!createPlotter(width, height, bounds))
+					return;
+				VectorProcState vecPs(*this->vectorPlotter);
+				withGeometry(vecPs, [&](auto& procState) {
+					interpret(rdPlot, header, procState, interactive);
+				});
+			} else {
+				StatsProcState statsPs;
+				withGeometry(statsPs, [&](auto& procState) {
+					interpret(rdPlot, header, procState, interactive);
+				});
 			}
 
 			if(interactive) {
@@ -26,25 +26,42 @@ private:
   Canvas *canvas;
   uint8_t intensity[1];
 public:
-  Point penPos;
+  IPoint penPos;
 
-  VectorPlotter(dim width, dim height, BoundingBox* clip = NULL) :
-    clip(clip), down(false), penPos(1300, 0) {
+  // with the bounding box of the cuts in millimetres, only that part of the bed
+  // plus the configured margin is allocated
+  VectorPlotter(dim width, dim height, BoundingBox* clip = NULL, const BoundingBox* cutBounds = NULL) :
+    clip(clip), down(false), penPos(1300000, 0) {
     if (clip != NULL) {
       width = clip->min(width, clip->lr.x - clip->ul.x);
       height = clip->min(height, clip->lr.y - clip->ul.y);
     }
     intensity[0] = 255;
+
+    BoundingBox region;
+    if (cutBounds != NULL) {
+      icoord margin = Config::singleton()->prescanMargin * 1000;
+      IPoint ul = toCanvas(IPoint(cutBounds->ul));
+      IPoint lr = toCanvas(IPoint(cutBounds->lr));
+      region = BoundingBox(IPoint(ul.x - margin, ul.y - margin).toPoint(),
+          IPoint(lr.x + margin, lr.y + margin).toPoint());
+    }
+
     if(Config::singleton()->screenSize != NULL)
-      this->canvas = new Canvas(width * 10, height * 10, Config::singleton()->screenSize->ul.x, Config::singleton()->screenSize->ul.y);
+      this->canvas = new Canvas(width * 10, height * 10, Config::singleton()->screenSize->ul.x, Config::singleton()->screenSize->ul.y,
+          NULL, cutBounds != NULL ? &region : NULL);
     else
-      this->canvas = new Canvas(width * 10, height * 10);
+      this->canvas = new Canvas(width * 10, height * 10, 0, 0, NULL, cutBounds != NULL ? &region : NULL);
   }
 
   VectorPlotter(BoundingBox* clip = NULL) :
     clip(clip), down(false), canvas(NULL), penPos(0, 0) {
   }
 
+  virtual ~VectorPlotter() {
+    delete canvas;
+  }
+
   bool isPenDown() {
 	  return down;
   }
@@ -59,8 +76,8 @@ public:
     Statistic::singleton()->announcePenDown(SLOT_VECTOR);
   }
 
-  void move(coord x, coord y) {
-    Point m(x, y);
+  void move(icoord x, icoord y) {
+    IPoint m(x, y);
     move(m);
   }
 
@@ -72,49 +89,48 @@ public:
     return this->intensity[0];
   }
 
-  virtual void draw(const Point& from, const Point& to) {
+  virtual void draw(const IPoint& from, const IPoint& to) {
     if(from == to) {
       Trace::singleton()->warn("zero length drawing operation?");
       return;
     }
-    Point drawFrom = from;
-    Point drawTo = to;
-
-    coord clip_offX = 0;
-    coord clip_offY = 0;
-
-    //apply clipping and update bounding box
-    if (this->clip) {
-      drawTo = this->clip->shape(drawTo);
-      drawFrom = this->clip->shape(drawFrom);
-      clip_offX = clip->ul.x;
-      clip_offY = clip->ul.y;
+    IPoint drawFrom = toCanvas(from);
+    IPoint drawTo = toCanvas(to);
+
+    if (Config::singleton()->debugLevel >= LVL_DEBUG) {
+      stringstream ss;
+      ss << "\t\t" << drawFrom << " - " << drawTo << " i = " << (unsigned int)this->intensity[0];
+      Trace::singleton()->debug(ss.str());
     }
 
-    drawFrom.x -= clip_offX;
-    drawFrom.y -= clip_offY;
-    drawTo.x -= clip_offX;
-    drawTo.y -= clip_offY;
+    canvas->drawCut(drawFrom.x, drawFrom.y, drawTo.x, drawTo.y);
+  }
 
-    stringstream ss;
-    ss << "\t\t" << drawFrom << " - " << drawTo << " i = " << (unsigned int)this->intensity[0];
-    Trace::singleton()->debug(ss.str());
+  // applies the clipping. the clip box is in millimetres.
+  // keeps the order of the coordinates, so boxes map to boxes.
+  IPoint toCanvas(const IPoint& p) const {
+    if (this->clip == NULL)
+      return p;
 
-    canvas->drawCut(drawFrom.x, drawFrom.y, drawTo.x, drawTo.y);
+    Point shape = p.toPoint();
+    IPoint shaped(this->clip->shape(shape));
+    IPoint clipOff(clip->ul);
+    return IPoint(shaped.x - clipOff.x, shaped.y - clipOff.y);
   }
 
-  void move(Point& to) {
+  void move(IPoint& to) {
 	  if (penPos != to) {
       if (down) {
         draw(penPos, to);
-        Statistic::singleton()->announceWork(penPos, to, SLOT_VECTOR);
+        Statistic::singleton()->announceWork(penPos.toPoint(), to.toPoint(), SLOT_VECTOR);
       } else {
         canvas->drawLine(penPos.x, penPos.y, to.x, to.y);
-        Statistic::singleton()->announceMove(penPos, to, SLOT_VECTOR);
+        Statistic::singleton()->announceMove(penPos.toPoint(), to.toPoint(), SLOT_VECTOR);
       }
 
       this->penPos = to;
-      Trace::singleton()->logPlotterStat(penPos);
+      Point pos = penPos.toPoint();
+      Trace::singleton()->logPlotterStat(pos);
     }
   }
 
@@ -0,0 +1,57 @@
+#include "RdIndex.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+void RdIndex::scanScalar(const uint8_t* begin, const uint8_t* end, off64_t off) {
+	for (const uint8_t* p = begin; p != end; ++p) {
+		if (*p >= 0x80)
+			entries_.push_back(off + (p - begin));
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void RdIndex::scanSse2(const uint8_t* begin, const uint8_t* end, off64_t off) {
+	const uint8_t* p = begin;
+	for (; end - p >= 16; p += 16) {
+		uint32_t mask = _mm_movemask_epi8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+		while (mask) {
+			size_t i = __builtin_ctz(mask);
+			entries_.push_back(off + (p - begin) + i);
+			mask &= mask - 1;
+		}
+	}
+	scanScalar(p, end, off + (p - begin));
+}
+
+__attribute__((target("avx2")))
+void RdIndex::scanAvx2(const uint8_t* begin, const uint8_t* end, off64_t off) {
+	const uint8_t* p = begin;
+	for (; end - p >= 32; p += 32) {
+		uint32_t mask = _mm256_movemask_epi8(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+		while (mask) {
+			size_t i = __builtin_ctz(mask);
+			entries_.push_back(off + (p - begin) + i);
+			mask &= mask - 1;
+		}
+	}
+	scanScalar(p, end, off + (p - begin));
+}
+#endif
+
+void RdIndex::scan(const uint8_t* begin, const uint8_t* end, off64_t off) {
+	// most instructions are moves and cuts of 3 to 11 bytes
+	entries_.reserve(entries_.size() + (end - begin) / 4);
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return scanAvx2(begin, end, off);
+	if (__builtin_cpu_supports("sse2"))
+		return scanSse2(begin, end, off);
+#endif
+	scanScalar(begin, end, off);
+}
@@ -0,0 +1,44 @@
+#ifndef SRC_RDINDEX_HPP_
+#define SRC_RDINDEX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "RdInstr.hpp"
+
+/*
+ * Offsets of the instructions in a window of descrambled bytes.
+ * An instruction starts at every byte >= 0x80, the scan is a movemask over the window.
+ */
+class RdIndex {
+private:
+	// file offsets, sorted
+	std::vector<off64_t> entries_;
+
+	void scanScalar(const uint8_t* begin, const uint8_t* end, off64_t off);
+#if defined(__x86_64__) || defined(__i386__)
+	void scanSse2(const uint8_t* begin, const uint8_t* end, off64_t off);
+	void scanAvx2(const uint8_t* begin, const uint8_t* end, off64_t off);
+#endif
+public:
+	RdIndex() : entries_() {
+	}
+
+	// appends the instructions found in [begin, end). begin is at file offset off.
+	void scan(const uint8_t* begin, const uint8_t* end, off64_t off);
+
+	// keeps the memory for the next window
+	void clear() {
+		entries_.clear();
+	}
+
+	size_t size() const {
+		return entries_.size();
+	}
+
+	off64_t offset(size_t i) const {
+		return entries_[i];
+	}
+};
+
+#endif /* SRC_RDINDEX_HPP_ */
@@ -0,0 +1,134 @@
+#include "RdInput.hpp"
+#include "Scramble.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+constexpr size_t RdInput::CHUNK_SIZE;
+constexpr size_t RdInput::MIN_CHUNK_SIZE;
+
+// copies everything left in fd to an unlinked temporary file. -1 on errors.
+static int spool(int fd) {
+	FILE* file = tmpfile();
+	int tmp = file != NULL ? dup(fileno(file)) : -1;
+	if (file != NULL)
+		fclose(file);
+	if (tmp < 0)
+		return -1;
+
+	std::vector<char> buffer(1 << 16);
+	ssize_t len;
+	while ((len = ::read(fd, buffer.data(), buffer.size())) != 0) {
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 || write(tmp, buffer.data(), len) != len) {
+			close(tmp);
+			return -1;
+		}
+	}
+	if (lseek(tmp, 0, SEEK_SET) != 0) {
+		close(tmp);
+		return -1;
+	}
+	return tmp;
+}
+
+RdInput* RdInput::open(const char* filename, bool seekable, size_t budget) {
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	if (!regular && seekable) {
+		int tmp = spool(fd);
+		close(fd);
+		if (tmp < 0)
+			return NULL;
+		fd = tmp;
+		regular = true;
+	}
+	// about four blocks for the window and the held ones, two spare ones and the index
+	size_t chunkSize = budget > 0 ? std::clamp(budget / 16, MIN_CHUNK_SIZE, CHUNK_SIZE) : CHUNK_SIZE;
+	return new RdInput(fd, regular, chunkSize);
+}
+
+RdInput::RdInput(int fd, bool seekable, size_t chunkSize) :
+		fd_(fd), seekable_(seekable), chunkSize_(chunkSize), blocks_(), spare_(), released_(0), begin_(NULL), end_(NULL),
+		offset_(0) {
+}
+
+RdInput::~RdInput() {
+	close(fd_);
+}
+
+size_t RdInput::read(uint8_t* dst, size_t len) {
+	size_t done = 0;
+	while (done < len) {
+		ssize_t got = ::read(fd_, dst + done, len - done);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		done += got;
+	}
+	return done;
+}
+
+void RdInput::freeReleased() {
+	off64_t released = released_.load(std::memory_order_acquire);
+	while (blocks_.size() > 1 && blocks_[1].offset <= released) {
+		if (spare_.size() < SPARE_BLOCKS)
+			spare_.push_back(std::move(blocks_.front().bytes));
+		blocks_.pop_front();
+	}
+}
+
+bool RdInput::refill(const uint8_t*& cursor) {
+	size_t keep = end_ - cursor;
+	off64_t start = offsetOf(cursor);
+	std::vector<uint8_t> bytes;
+	if (!spare_.empty()) {
+		bytes.swap(spare_.back());
+		spare_.pop_back();
+	}
+	bytes.resize(keep + chunkSize_);
+	size_t got = read(bytes.data() + keep, chunkSize_);
+	if (got == 0) {
+		spare_.push_back(std::move(bytes));
+		return false;
+	}
+
+	if (keep > 0)
+		memcpy(bytes.data(), cursor, keep);
+	bytes.resize(keep + got);
+	descramble(bytes.data() + keep, bytes.data() + keep, got);
+	blocks_.push_back( { start, std::move(bytes) });
+
+	offset_ = start;
+	begin_ = blocks_.back().bytes.data();
+	end_ = begin_ + blocks_.back().bytes.size();
+	cursor = begin_;
+	freeReleased();
+	return true;
+}
+
+bool RdInput::rewind() {
+	if (!seekable_ || lseek(fd_, 0, SEEK_SET) != 0)
+		return false;
+
+	release(0);
+	while (!blocks_.empty()) {
+		if (spare_.size() < SPARE_BLOCKS)
+			spare_.push_back(std::move(blocks_.front().bytes));
+		blocks_.pop_front();
+	}
+	offset_ = 0;
+	begin_ = NULL;
+	end_ = NULL;
+	return true;
+}
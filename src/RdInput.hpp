@@ -0,0 +1,102 @@
+#ifndef SRC_RDINPUT_HPP_
+#define SRC_RDINPUT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "RdInstr.hpp"
+
+/*
+ * A window of contiguous descrambled bytes of an RD-file.
+ * file offsets are computed from pointers into the window: offset() + (p - begin())
+ * The file is read a chunk at a time into a block, which starts with the unfinished tail of the
+ * previous one, and descrambled there. Instructions can be views into the blocks. A block is
+ * freed once the instructions in it are released, so memory doesn't grow with the file.
+ */
+class RdInput {
+private:
+	static constexpr size_t CHUNK_SIZE = 1 << 18;
+	static constexpr size_t MIN_CHUNK_SIZE = 1 << 12;
+	// freed blocks kept to be reused
+	static constexpr size_t SPARE_BLOCKS = 2;
+
+	struct Block {
+		// file offset of the first byte
+		off64_t offset;
+		std::vector<uint8_t> bytes;
+	};
+
+	int fd_;
+	bool seekable_;
+	size_t chunkSize_;
+	// the window is the last one
+	std::deque<Block> blocks_;
+	std::vector<std::vector<uint8_t>> spare_;
+	// the instructions before this file offset are released
+	std::atomic<off64_t> released_;
+	const uint8_t* begin_;
+	const uint8_t* end_;
+	off64_t offset_;
+
+	RdInput(int fd, bool seekable, size_t chunkSize);
+
+	// reads up to len raw bytes. less only at the end of the file or on errors.
+	size_t read(uint8_t* dst, size_t len);
+	// frees the blocks only holding released instructions
+	void freeReleased();
+public:
+	~RdInput();
+
+	RdInput(const RdInput&) = delete;
+	RdInput& operator=(const RdInput&) = delete;
+
+	const uint8_t* begin() const {
+		return begin_;
+	}
+
+	const uint8_t* end() const {
+		return end_;
+	}
+
+	// file offset of begin()
+	off64_t offset() const {
+		return offset_;
+	}
+
+	off64_t offsetOf(const uint8_t* p) const {
+		return offset_ + (p - begin_);
+	}
+
+	// Appends the next descrambled chunk to the window and moves the window to start at cursor.
+	// cursor is rebased accordingly. Returns false if there is nothing left to read.
+	bool refill(const uint8_t*& cursor);
+
+	// The instructions starting before file offset off aren't used anymore.
+	// Can be called from another thread than refill().
+	void release(off64_t off) {
+		released_.store(off, std::memory_order_release);
+	}
+
+	// Starts over at the beginning of the file. false if the input can't be read twice.
+	bool rewind();
+
+	// Whether the file can be read more than once, i.e. if it is a regular file
+	bool isSeekable() const {
+		return seekable_;
+	}
+
+	// the bytes read at a time
+	size_t chunkSize() const {
+		return chunkSize_;
+	}
+
+	// Input which can't be read twice (e.g. a pipe) is copied to a temporary file first
+	// if seekable is set. With a budget the chunks are small enough that the blocks of the
+	// window, the held and the spare ones and an index of them fit into it.
+	// NULL if the file can't be opened.
+	static RdInput* open(const char* filename, bool seekable = false, size_t budget = 0);
+};
+
+#endif /* SRC_RDINPUT_HPP_ */
@@ -23,7 +23,7 @@ string byteToHexString2(const uint8_t& b) {
 	return ss.str();
 }
 
-bool RdInstr::matches(const string& sig, const bool report) {
+bool RdInstr::matches(const string& sig, const bool report) const {
 	bool m = byteToHexString2(this->data[0]) == sig;
 	if (!m && report && Config::singleton()->debugLevel >= LVL_WARN) {
 		cerr << "expected: " << sig << " found: " << this->data[0] << endl;
@@ -2,7 +2,6 @@
 #define PCLFILE_H_
 
 #include <cstdint>
-#include <vector>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -19,13 +18,30 @@ using std::ostream;
 typedef off_t off64_t;
 #endif
 
+// non-owning view of a range of descrambled bytes
+class ByteView {
+  const uint8_t* begin_;
+  const uint8_t* end_;
+public:
+  ByteView() : begin_(NULL), end_(NULL) {}
+  ByteView(const uint8_t* begin, const uint8_t* end) : begin_(begin), end_(end) {}
+
+  const uint8_t* begin() const { return begin_; }
+  const uint8_t* end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  const uint8_t& operator[](size_t i) const { return begin_[i]; }
+};
+
+// an instruction is a view into the descrambled input, it doesn't own its bytes
 class RdInstr {
 public:
-  RdInstr(off64_t file_off) : data(), file_off(file_off) {}
-  std::vector<uint8_t> data;
+  RdInstr() : data(), file_off(0) {}
+  RdInstr(const uint8_t* begin, const uint8_t* end, off64_t file_off) : data(begin, end), file_off(file_off) {}
+  ByteView data;
   off64_t file_off;
 
-  bool matches(const string& sig, const bool report=false);
+  bool matches(const string& sig, const bool report=false) const;
   static const string pretty(char c);
   friend ostream& operator <<(ostream &os, const RdInstr &instr) {
 	std::stringstream ss;
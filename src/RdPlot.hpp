@@ -3,9 +3,11 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <fstream>
-#include <map>
+#include <cstring>
 #include <vector>
+#include "Arena.hpp"
+#include "RdIndex.hpp"
+#include "RdInput.hpp"
 #include "Trace.hpp"
 
 class RdPlot {
@@ -15,55 +17,67 @@ private:
 	static constexpr size_t ABS_MOVE_MAGIC_SIZE = 2;
 	static constexpr uint8_t ABS_MOVE_MAGIC[RD_MAGIC_SIZE] = { 0x88, 0x00 };
 
-	static constexpr uint8_t SCRAMBLE_MAGIC = 0x33;
-
-	std::ifstream* inputfile;
-	off64_t eof;
+	RdInput* input;
+	const uint8_t* cursor;
+	// the instructions left in the window, for readBatch()
+	RdIndex index;
+	Arena arena;
 	bool valid;
-
-	std::map<string, RdInstr*> settings;
+	// unless set, reading an instruction releases the ones before it
+	bool holding;
 
 	void readMagic() {
-		char* buffer = new char[RD_MAGIC_SIZE];
-		this->inputfile->read(buffer, RD_MAGIC_SIZE);
+		while (size_t(this->input->end() - this->cursor) < RD_MAGIC_SIZE
+				&& this->input->refill(this->cursor))
+			;
 
-		if (memcmp(RD_MAGIC, buffer, RD_MAGIC_SIZE) != 0) {
+		if (size_t(this->input->end() - this->cursor) < RD_MAGIC_SIZE
+				|| memcmp(RD_MAGIC, this->cursor, RD_MAGIC_SIZE) != 0) {
 			invalidate("magic doesn't match");
 		}
 	}
 
-	uint8_t descramble(uint8_t s) {
-		uint8_t a = (s + 0xFF) & 0xFF;
-		uint8_t b = a ^ SCRAMBLE_MAGIC;
-		uint8_t p = (b & 0x7E) | (b >> 7 & 0x01) | (b << 7 & 0x80);
-		return p;
+	bool fill() {
+		return this->cursor != this->input->end()
+				|| this->input->refill(this->cursor);
 	}
 
 	RdInstr* readInstr() {
-		off64_t off = this->inputfile->tellg();
-		uint8_t c = descramble(this->inputfile->get());
-		assert(c >= 0x80);
-		RdInstr* instr = new RdInstr(off);
-		instr->data.push_back(c);
-
-		while (this->inputfile->good()
-				&& (c = descramble(this->inputfile->get())) < 0x80) {
-			instr->data.push_back(c);
+		if (!this->holding)
+			this->input->release(this->input->offsetOf(this->cursor));
+		if (!fill())
+			return NULL;
+
+		assert(*this->cursor >= 0x80);
+		// the instruction ends right before the next byte >= 0x80.
+		// in case the window is exhausted on the way it is refilled starting at the instruction.
+		size_t len = 1;
+		for (;;) {
+			const uint8_t* p = this->cursor + len;
+			const uint8_t* end = this->input->end();
+			while (p != end && *p < 0x80)
+				++p;
+			len = p - this->cursor;
+			if (p != end || !this->input->refill(this->cursor))
+				break;
 		}
 
-		this->inputfile->unget();
-		return instr;
+		this->currentInstr = RdInstr(this->cursor, this->cursor + len,
+				this->input->offsetOf(this->cursor));
+		this->cursor += len;
+		return &this->currentInstr;
 	}
 
 public:
-	RdInstr* currentInstr;
+	RdInstr currentInstr;
 
-	RdPlot(std::ifstream *infile) :
-			inputfile(infile), eof(numeric_limits<off64_t>::max()), valid(true), currentInstr(
-					NULL) {
+	RdPlot(RdInput* input) :
+			input(input), cursor(input->begin()), index(), arena(), valid(true), holding(false),
+			currentInstr() {
 	}
 
 	virtual ~RdPlot() {
+		delete input;
 	}
 
 	bool isValid() {
@@ -75,8 +89,67 @@ public:
 		Trace::singleton()->printBacklog(cerr, "RD", msg);
 	}
 
-	bool good() const {
-		return this->valid && this->inputfile->good();
+	bool good() {
+		return this->valid && fill();
+	}
+
+	// see RdInput::isSeekable()
+	bool isSeekable() const {
+		return this->input->isSeekable();
+	}
+
+	// reads the job from the start again. false if the input can't be read twice.
+	bool rewind() {
+		if (!this->input->rewind())
+			return false;
+		this->cursor = this->input->begin();
+		return true;
+	}
+
+	// while holding, the instructions read stay valid until they are released
+	void hold(bool holding) {
+		this->holding = holding;
+	}
+
+	// see RdInput::release(). can be called from another thread than the reading one.
+	void release(off64_t off) {
+		this->input->release(off);
+	}
+
+	// allocations living as long as the job. released at once with the plot.
+	Arena& getArena() {
+		return this->arena;
+	}
+
+	// the instruction with a copy of its bytes in the arena, it outlives its block
+	RdInstr copy(const RdInstr& instr) {
+		uint8_t* bytes = static_cast<uint8_t*>(this->arena.allocate(instr.data.size(), 1));
+		memcpy(bytes, instr.data.begin(), instr.data.size());
+		return RdInstr(bytes, bytes + instr.data.size(), instr.file_off);
+	}
+
+	// reads up to max instructions, found through the index of the window. needs hold().
+	// a batch spans at most two chunks, so the blocks held for it are bounded as well.
+	void readBatch(std::vector<RdInstr>& instrs, size_t max) {
+		assert(this->holding);
+		instrs.clear();
+		off64_t batchEnd = this->input->offsetOf(this->cursor) + 2 * this->input->chunkSize();
+		while (instrs.size() < max && this->input->offsetOf(this->cursor) < batchEnd && fill()) {
+			off64_t off = this->input->offsetOf(this->cursor);
+			const uint8_t* begin = this->cursor;
+			this->index.clear();
+			this->index.scan(begin, this->input->end(), off);
+			// the last instruction of the window may go on in the next chunk
+			size_t i = 0;
+			for (; i + 1 < this->index.size() && instrs.size() < max
+					&& this->index.offset(i) < batchEnd; ++i) {
+				const uint8_t* next = begin + (this->index.offset(i + 1) - off);
+				instrs.push_back(RdInstr(this->cursor, next, this->index.offset(i)));
+				this->cursor = next;
+			}
+			if (i + 1 >= this->index.size() && instrs.size() < max)
+				instrs.push_back(*readInstr());
+		}
 	}
 
 	RdInstr* expectInstr(const char * expected = nullptr) {
@@ -85,7 +158,7 @@ public:
 
 		RdInstr* instr = readInstr();
 
-		if (instr->file_off == eof) {
+		if (instr == NULL) {
 			invalidate("end of file");
 			return NULL;
 		}
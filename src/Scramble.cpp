@@ -0,0 +1,87 @@
+#include "Scramble.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+class DescrambleTable {
+public:
+	uint8_t table[256];
+
+	DescrambleTable() {
+		for (size_t i = 0; i < 256; ++i)
+			table[i] = ::descramble(uint8_t(i));
+	}
+};
+
+static const DescrambleTable descrambleTable;
+
+void descrambleScalar(const uint8_t* src, uint8_t* dst, size_t len) {
+	for (size_t i = 0; i < len; ++i)
+		dst[i] = descramble(src[i]);
+}
+
+void descrambleLut(const uint8_t* src, uint8_t* dst, size_t len) {
+	const uint8_t* table = descrambleTable.table;
+	for (size_t i = 0; i < len; ++i)
+		dst[i] = table[src[i]];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// There are no 8-bit shifts, but masking the 16-bit shifts drops the bits crossing byte lanes.
+__attribute__((target("sse2")))
+void descrambleSse2(const uint8_t* src, uint8_t* dst, size_t len) {
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i magic = _mm_set1_epi8(SCRAMBLE_MAGIC);
+	const __m128i mid = _mm_set1_epi8(0x7E);
+	const __m128i low = _mm_set1_epi8(0x01);
+	const __m128i high = _mm_set1_epi8(char(0x80));
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i b = _mm_xor_si128(_mm_sub_epi8(s, one), magic);
+		__m128i p = _mm_or_si128(_mm_and_si128(b, mid),
+				_mm_or_si128(_mm_and_si128(_mm_srli_epi16(b, 7), low),
+						_mm_and_si128(_mm_slli_epi16(b, 7), high)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), p);
+	}
+	descrambleLut(src + i, dst + i, len - i);
+}
+
+__attribute__((target("avx2")))
+void descrambleAvx2(const uint8_t* src, uint8_t* dst, size_t len) {
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i magic = _mm256_set1_epi8(SCRAMBLE_MAGIC);
+	const __m256i mid = _mm256_set1_epi8(0x7E);
+	const __m256i low = _mm256_set1_epi8(0x01);
+	const __m256i high = _mm256_set1_epi8(char(0x80));
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		__m256i b = _mm256_xor_si256(_mm256_sub_epi8(s, one), magic);
+		__m256i p = _mm256_or_si256(_mm256_and_si256(b, mid),
+				_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(b, 7), low),
+						_mm256_and_si256(_mm256_slli_epi16(b, 7), high)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+	}
+	descrambleLut(src + i, dst + i, len - i);
+}
+#endif
+
+typedef void (*DescrambleKernel)(const uint8_t*, uint8_t*, size_t);
+
+static DescrambleKernel selectKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return descrambleAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return descrambleSse2;
+#endif
+	return descrambleLut;
+}
+
+void descramble(const uint8_t* src, uint8_t* dst, size_t len) {
+	static const DescrambleKernel kernel = selectKernel();
+	kernel(src, dst, len);
+}
@@ -0,0 +1,34 @@
+#ifndef SRC_SCRAMBLE_HPP_
+#define SRC_SCRAMBLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint8_t SCRAMBLE_MAGIC = 0x33;
+
+// reference implementation: add 0xFF, xor the magic and swap bit 0 and 7
+inline uint8_t descramble(uint8_t s) {
+	uint8_t a = (s + 0xFF) & 0xFF;
+	uint8_t b = a ^ SCRAMBLE_MAGIC;
+	uint8_t p = (b & 0x7E) | (b >> 7 & 0x01) | (b << 7 & 0x80);
+	return p;
+}
+
+// the inverse of descramble(), for writing RD-files
+inline uint8_t scramble(uint8_t p) {
+	uint8_t b = (p & 0x7E) | (p >> 7 & 0x01) | (p << 7 & 0x80);
+	return ((b ^ SCRAMBLE_MAGIC) + 1) & 0xFF;
+}
+
+// bulk kernels. src and dst may be the same buffer.
+void descrambleScalar(const uint8_t* src, uint8_t* dst, size_t len);
+void descrambleLut(const uint8_t* src, uint8_t* dst, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+void descrambleSse2(const uint8_t* src, uint8_t* dst, size_t len);
+void descrambleAvx2(const uint8_t* src, uint8_t* dst, size_t len);
+#endif
+
+// descrambles a whole buffer using the fastest kernel supported by the cpu
+void descramble(const uint8_t* src, uint8_t* dst, size_t len);
+
+#endif /* SRC_SCRAMBLE_HPP_ */
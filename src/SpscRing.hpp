@@ -0,0 +1,145 @@
+#ifndef SRC_SPSCRING_HPP_
+#define SRC_SPSCRING_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A bounded lock-free queue between exactly one producer and one consumer thread.
+ * push() waits while the ring is full, so a slow consumer throttles the producer.
+ * A waiting side spins for a short while and then sleeps until the other side wakes it.
+ * Both sides give up waiting once the stop flag is raised. It is set from a signal handler,
+ * which can't wake anyone, so sleepers also look at it every WAKE_INTERVAL.
+ */
+template<typename T>
+class SpscRing {
+private:
+	static constexpr int SPINS = 64;
+	static constexpr std::chrono::milliseconds WAKE_INTERVAL { 10 };
+
+	std::vector<T> slots_;
+	size_t mask_;
+	// next slot to pop. written by the consumer only
+	alignas(64) std::atomic<size_t> head_;
+	// next slot to push. written by the producer only
+	alignas(64) std::atomic<size_t> tail_;
+	alignas(64) std::atomic<bool> closed_;
+	// last seen index of the other side, saves touching its cache line on every call
+	alignas(64) size_t cachedHead_;
+	alignas(64) size_t cachedTail_;
+	// the sleeping side, if any, waits on cond_
+	alignas(64) std::atomic<int> sleepers_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+
+	// sleeps until ready() or WAKE_INTERVAL passed
+	template<typename Ready>
+	void sleep(Ready ready) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		sleepers_.fetch_add(1, std::memory_order_seq_cst);
+		cond_.wait_for(lock, WAKE_INTERVAL, ready);
+		sleepers_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// wakes the other side if it sleeps
+	void wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers_.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			cond_.notify_all();
+		}
+	}
+
+public:
+	// capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity) :
+			slots_(), mask_(0), head_(0), tail_(0), closed_(false), cachedHead_(0), cachedTail_(0),
+			sleepers_(0), mutex_(), cond_() {
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		slots_.resize(size);
+		mask_ = size - 1;
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	bool tryPush(const T& item) {
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - cachedHead_ == slots_.size()) {
+			cachedHead_ = head_.load(std::memory_order_acquire);
+			if (tail - cachedHead_ == slots_.size())
+				return false;
+		}
+		slots_[tail & mask_] = item;
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& item) {
+		size_t head = head_.load(std::memory_order_relaxed);
+		if (head == cachedTail_) {
+			cachedTail_ = tail_.load(std::memory_order_acquire);
+			if (head == cachedTail_)
+				return false;
+		}
+		item = slots_[head & mask_];
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// waits for a free slot. false if stopped.
+	bool push(const T& item, const std::atomic<bool>& stop) {
+		for (int spins = 0; !tryPush(item); ++spins) {
+			if (stop.load(std::memory_order_relaxed))
+				return false;
+			if (spins < SPINS) {
+				std::this_thread::yield();
+				continue;
+			}
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			sleep([&] {
+				return tail - head_.load(std::memory_order_acquire) < slots_.size()
+						|| stop.load(std::memory_order_relaxed);
+			});
+		}
+		wake();
+		return true;
+	}
+
+	// waits for an item. false if the ring is closed and drained, or if stopped.
+	bool pop(T& item, const std::atomic<bool>& stop) {
+		for (int spins = 0; !tryPop(item); ++spins) {
+			if (closed_.load(std::memory_order_acquire))
+				return tryPop(item);
+			if (stop.load(std::memory_order_relaxed))
+				return false;
+			if (spins < SPINS) {
+				std::this_thread::yield();
+				continue;
+			}
+			size_t head = head_.load(std::memory_order_relaxed);
+			sleep([&] {
+				return head != tail_.load(std::memory_order_acquire)
+						|| closed_.load(std::memory_order_acquire)
+						|| stop.load(std::memory_order_relaxed);
+			});
+		}
+		wake();
+		return true;
+	}
+
+	// called by the producer after the last push
+	void close() {
+		closed_.store(true, std::memory_order_release);
+		wake();
+	}
+};
+
+#endif /* SRC_SPSCRING_HPP_ */
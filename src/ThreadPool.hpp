@@ -0,0 +1,91 @@
+#ifndef SRC_THREADPOOL_HPP_
+#define SRC_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of worker threads running indexed tasks.
+ * run() hands out the task numbers through an atomic counter, the calling thread helps out.
+ */
+class ThreadPool {
+private:
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable startCond_;
+	std::condition_variable doneCond_;
+	const std::function<void(size_t)>* task_;
+	size_t numTasks_;
+	std::atomic<size_t> next_;
+	size_t active_;
+	size_t generation_;
+	bool stop_;
+
+	void drain() {
+		size_t i;
+		while ((i = next_++) < numTasks_)
+			(*task_)(i);
+	}
+
+	void work() {
+		size_t generation = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				startCond_.wait(lock, [&] { return stop_ || generation != generation_; });
+				if (stop_)
+					return;
+				generation = generation_;
+			}
+			drain();
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (--active_ == 0)
+				doneCond_.notify_all();
+		}
+	}
+
+public:
+	// threads includes the calling thread
+	explicit ThreadPool(size_t threads) :
+			task_(NULL), numTasks_(0), next_(0), active_(0), generation_(0), stop_(false) {
+		for (size_t i = 1; i < threads; ++i)
+			workers_.push_back(std::thread([this] { work(); }));
+	}
+
+	virtual ~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		startCond_.notify_all();
+		for (auto& w : workers_)
+			w.join();
+	}
+
+	size_t size() const {
+		return workers_.size() + 1;
+	}
+
+	// runs task(0) ... task(n - 1) and returns when all of them are done
+	void run(size_t n, const std::function<void(size_t)>& task) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			task_ = &task;
+			numTasks_ = n;
+			next_ = 0;
+			active_ = workers_.size();
+			++generation_;
+		}
+		startCond_.notify_all();
+		drain();
+		std::unique_lock<std::mutex> lock(mutex_);
+		doneCond_.wait(lock, [&] { return active_ == 0; });
+	}
+};
+
+#endif /* SRC_THREADPOOL_HPP_ */
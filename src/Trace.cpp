@@ -9,25 +9,25 @@ Trace* Trace::singleton() {
   return instance;
 }
 
-void Trace::logInstr(RdInstr* instr) {
+void Trace::logInstr(const RdInstr* instr) {
 	if (Config::singleton()->debugLevel >= LVL_DEBUG)
 		cerr << penPos << "\t" << *instr << endl;
 
 	if (backlog.size() >= backlogSize)
-		backlog.erase(backlog.begin());
+		backlog.pop_front();
 
-	backlog.push_back(instr);
+	backlog.push_back(*instr);
 }
 
 void Trace::logPlotterStat(Point &penPos) {
 	this->penPos = penPos;
 }
 
-std::list<RdInstr*>::iterator Trace::backlogIterator() {
+std::deque<RdInstr>::iterator Trace::backlogIterator() {
 	return backlog.begin();
 }
 
-std::list<RdInstr*>::iterator Trace::backlogEnd() {
+std::deque<RdInstr>::iterator Trace::backlogEnd() {
 	return backlog.end();
 }
 
@@ -54,9 +54,9 @@ void Trace::printBacklog(ostream &os, string caller, string msg) {
 	if (backlog.empty()) {
 		os << "(backlog N/A)" << endl;
 	} else {
-		for (std::list<RdInstr*>::iterator it = backlogIterator();
+		for (std::deque<RdInstr>::iterator it = backlogIterator();
 				it != backlogEnd(); it++)
-			os << "\t" << *(*it) << endl;
+			os << "\t" << *it << endl;
 	}
 	os << endl;
 }
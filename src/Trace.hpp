@@ -3,14 +3,14 @@
 
 #include <cstdint>
 #include <string>
-#include <list>
+#include <deque>
 #include "2D.hpp"
 #include "RdInstr.hpp"
 
 class Trace {
 private:
   const uint8_t backlogSize;
-  std::list<RdInstr*> backlog;
+  std::deque<RdInstr> backlog;
   static Trace* instance;
   Point penPos;
 
@@ -18,10 +18,10 @@ private:
 public:
   static Trace* singleton();
 
-  void logInstr(RdInstr* instr);
+  void logInstr(const RdInstr* instr);
   void logPlotterStat(Point &penPos);
-  std::list<RdInstr*>::iterator backlogIterator();
-  std::list<RdInstr*>::iterator backlogEnd();
+  std::deque<RdInstr>::iterator backlogIterator();
+  std::deque<RdInstr>::iterator backlogEnd();
   void info(string msg);
   void warn(string msg);
   void debug(string msg);
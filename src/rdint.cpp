@@ -6,6 +6,7 @@
 #include "Interpreter.hpp"
 #include "2D.hpp"
 #include "Plotter.hpp"
+#include "Geometry.hpp"
 #include <stdlib.h>
 #include <csignal>
 
@@ -46,8 +47,14 @@ Statistic* Statistic::singleton() {
 	return instance;
 }
 
+// the signal which interrupted the run, 0 if none did
+static volatile sig_atomic_t caughtSignal = 0;
+
 void sigint_handler(int sig) {
-	Debugger::getInstance()->quit();
+	caughtSignal = sig;
+	Interpreter::stop();
+	if (Debugger::getInstance() != NULL)
+		Debugger::getInstance()->quit();
 }
 
 int main(int argc, char *argv[]) {
@@ -56,14 +63,50 @@ int main(int argc, char *argv[]) {
 	Trace* trace = Trace::singleton();
 	Config* config = Config::singleton();
 	config->parseCommandLine(argc, argv);
-	ifstream *infile = new ifstream(config->ifilename, ios::in | ios::binary);
-	RdPlot* plot = new RdPlot(infile);
-
 	Interpreter intr;
+	if (config->geometryFilename != NULL)
+		intr.geometry = new Geometry();
 
-	intr.run(plot, config->interactive);
+	if (Geometry::isGeometryFile(config->ifilename)) {
+		std::ifstream is(config->ifilename, std::ios::in | std::ios::binary);
+		if (!is.is_open()) {
+			cerr << "Can't open file: " << config->ifilename << endl;
+			return 1;
+		}
+		Geometry cached;
+		if (!cached.load(is)) {
+			cerr << "Not a valid geometry file: " << config->ifilename << endl;
+			return 1;
+		}
+		if (config->interactive) {
+			trace->warn("There are no instructions to debug in a geometry file, ignoring -i");
+			config->interactive = false;
+		}
+		intr.run(cached);
+	} else {
+		// the cuts are prescanned in an extra pass, a pipe can't be read twice
+		RdInput* input = RdInput::open(config->ifilename, config->prescanMargin >= 0,
+				config->inputBudget());
+		if (input == NULL) {
+			cerr << "Can't open file: " << config->ifilename << endl;
+			return 1;
+		}
+		RdPlot* plot = new RdPlot(input);
+		intr.run(plot, config->interactive);
+		// the details are in the instruction backlog in debug level
+		if (!plot->isValid()) {
+			cerr << "Not a valid RD-file: " << config->ifilename << endl;
+			return 1;
+		}
+	}
+	if (intr.vectorPlotter != NULL && !intr.vectorPlotter->getCanvas()->isValid()) {
+		cerr << intr.vectorPlotter->getCanvas()->getError() << endl;
+		return 1;
+	}
+	if (Interpreter::stopped())
+		trace->warn("Interrupted. The output is incomplete.");
 
-	BoundingBox& vBox = intr.vectorPlotter->getBoundingBox();
+	BoundingBox& vBox = Statistic::singleton()->getBoundingBox(SLOT_VECTOR);
 	if (vBox.isValid()) {
 		if (config->vectorFilename != NULL)
 			intr.vectorPlotter->dumpCanvas(string(config->vectorFilename));
@@ -71,6 +114,13 @@ int main(int argc, char *argv[]) {
 		trace->warn("Vector image is empty.");
 	}
 
+	if (intr.geometry != NULL) {
+		std::ofstream os(config->geometryFilename, std::ios::out | std::ios::binary);
+		intr.geometry->save(os);
+		if (!os.good())
+			trace->warn("Can't write geometry file.");
+	}
+
 //  BoundingBox& bmpBox = intr.bitmapPlotter->getBoundingBox();
 //  if (bmpBox.isValid()) {
 //    if (config->rasterFilename != NULL)
@@ -81,8 +131,12 @@ int main(int argc, char *argv[]) {
 
 	if (config->debugLevel >= LVL_INFO) {
 		Statistic::singleton()->printSlot(cout, SLOT_VECTOR);
+		intr.printStats(cout);
 //    Statistic::singleton()->printSlot(cout, SLOT_RASTER);
 	}
 
-	return 0;
+	// the live window shows what was drawn last and SDL is shut down
+	delete intr.vectorPlotter;
+	// like a shell, 128 + the signal when the run was interrupted
+	return caughtSignal != 0 ? 128 + caughtSignal : 0;
 }
@@ -0,0 +1,59 @@
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// the peak RSS of rdint with --mem-budget on a large job against the same run on a tiny one,
+// which only costs the baseline of the program, its libraries and threads:
+// BudgetTest <rdint> <tiny.rd> <large.rd>
+static const char* OUTPUT = "test/budget.pbm";
+static int failures = 0;
+
+// runs rdint on the job and returns its peak RSS in kB, -1 if it failed
+static long peakRss(const char* rdint, const char* job, const char* jobs, const char* budget) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		execl(rdint, rdint, "-d", "quiet", "-j", jobs, "--mem-budget", budget, "-v", OUTPUT, job,
+				(char*) NULL);
+		_exit(127);
+	}
+	int status;
+	struct rusage usage;
+	if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != 0)
+		return -1;
+	return usage.ru_maxrss;
+}
+
+static void checkBudget(const char* rdint, const char* tiny, const char* large, const char* jobs,
+		const char* budget, long budgetKb) {
+	long baseline = peakRss(rdint, tiny, jobs, budget);
+	long peak = peakRss(rdint, large, jobs, budget);
+	if (baseline < 0 || peak < 0) {
+		printf("FAIL -j%s --mem-budget %s: rdint failed\n", jobs, budget);
+		++failures;
+	} else if (peak > baseline + budgetKb) {
+		printf("FAIL -j%s --mem-budget %s: peak %ld kB, baseline %ld kB\n", jobs, budget, peak,
+				baseline);
+		++failures;
+	} else {
+		printf("ok -j%s --mem-budget %s: peak %ld kB, baseline %ld kB\n", jobs, budget, peak,
+				baseline);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s <rdint> <tiny.rd> <large.rd>\n", argv[0]);
+		return 1;
+	}
+	for (const char* jobs : { "1", "4" }) {
+		checkBudget(argv[1], argv[2], argv[3], jobs, "1M", 1024);
+		checkBudget(argv[1], argv[2], argv[3], jobs, "4M", 4096);
+	}
+	unlink(OUTPUT);
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <random>
+#include "../Decode.hpp"
+
+// the fixed width parsers against parseUnsignedValue() and parseSignedValue(): every 1 and 2
+// byte field, and random 5 byte fields. the bytes of a field are 7 bit.
+static int failures = 0;
+
+template<size_t N>
+static bool checkField(const uint8_t* field) {
+	Data data(field, field + N);
+	if (parseUnsigned<N>(field) == parseUnsignedValue(data)
+			&& parseSigned<N>(field) == parseSignedValue(data))
+		return true;
+
+	printf("FAIL %zu byte field:", N);
+	for (size_t i = 0; i < N; ++i)
+		printf(" %02x", field[i]);
+	printf("\n");
+	++failures;
+	return false;
+}
+
+int main() {
+	static constexpr size_t RANDOM_FIELDS = 1000000;
+	uint8_t field[5];
+	bool ok = true;
+	for (field[0] = 0; field[0] < 0x80 && ok; ++field[0])
+		ok = checkField<1>(field);
+	if (ok)
+		printf("ok 1 byte fields\n");
+
+	ok = true;
+	for (field[0] = 0; field[0] < 0x80 && ok; ++field[0]) {
+		for (field[1] = 0; field[1] < 0x80 && ok; ++field[1])
+			ok = checkField<2>(field);
+	}
+	if (ok)
+		printf("ok 2 byte fields\n");
+
+	// the first byte takes the extremes more often, for the sign and the overflow
+	std::mt19937 random(42);
+	ok = true;
+	for (size_t i = 0; i < RANDOM_FIELDS && ok; ++i) {
+		for (uint8_t& b : field)
+			b = random() & 0x7F;
+		if (i % 4 == 0)
+			field[0] = i % 8 == 0 ? 0x7F : 0x40;
+		ok = checkField<5>(field);
+	}
+	if (ok)
+		printf("ok 5 byte fields\n");
+	return failures == 0 ? 0 : 1;
+}
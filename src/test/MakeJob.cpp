@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <random>
+#include <vector>
+#include "../Scramble.hpp"
+
+// writes a reproducible RD-file with a header and a mix of absolute and relative cuts and moves
+// on a 600x400mm bed: MakeJob <instructions> <file.rd>
+static std::vector<uint8_t> job;
+
+static void put(std::initializer_list<uint8_t> bytes) {
+	job.insert(job.end(), bytes);
+}
+
+// n 7 bit bytes, big endian. negative values are two's complement.
+static void put(int64_t v, size_t n) {
+	if (v < 0)
+		v += int64_t(1) << (7 * n);
+	for (size_t i = n; i-- > 0;)
+		job.push_back((v >> (7 * i)) & 0x7F);
+}
+
+int main(int argc, char** argv) {
+	static constexpr int64_t BED_X = 600000;
+	static constexpr int64_t BED_Y = 400000;
+	static constexpr int64_t MARGIN = 1000;
+	static constexpr int64_t STEP = 3000;
+	char* end = NULL;
+	long instructions = argc == 3 ? strtol(argv[1], &end, 10) : 0;
+	if (end == NULL || *end != '\0' || instructions <= 0) {
+		fprintf(stderr, "usage: %s <instructions> <file.rd>\n", argv[0]);
+		return 1;
+	}
+
+	std::mt19937 rng(42);
+	auto uniform = [&](int64_t min, int64_t max) {
+		return std::uniform_int_distribution<int64_t>(min, max)(rng);
+	};
+
+	put( { 0xD8, 0x12 });
+	put( { 0xE7, 0x03 });
+	put(0, 5);
+	put(0, 5);
+	put( { 0xE7, 0x07 });
+	put(BED_X, 5);
+	put(BED_Y, 5);
+	put( { 0xCA, 0x06, 0x00 });
+	put(0x0000FF, 5);
+	put( { 0xCA, 0x02, 0x00 });
+	put( { 0xC9, 0x02 });
+	put(100000, 5);
+	put( { 0xC6, 0x01 });
+	put(8000, 2);
+	put( { 0x88 });
+	put(BED_X / 2, 5);
+	put(BED_Y / 2, 5);
+
+	for (long i = 0; i < instructions; ++i) {
+		int64_t kind = uniform(0, 99);
+		bool cut = uniform(0, 4) != 0;
+		if (kind < 40) {
+			put( { uint8_t(cut ? 0xA8 : 0x88) });
+			put(uniform(MARGIN, BED_X - MARGIN), 5);
+			put(uniform(MARGIN, BED_Y - MARGIN), 5);
+		} else if (kind < 70) {
+			put( { uint8_t(cut ? 0xA9 : 0x89) });
+			put(uniform(-STEP, STEP), 2);
+			put(uniform(-STEP, STEP), 2);
+		} else if (kind < 95) {
+			put( { uint8_t((cut ? 0xAA : 0x8A) + uniform(0, 1)) });
+			put(uniform(-STEP, STEP), 2);
+		} else {
+			uint8_t layer = uniform(0, 3);
+			put( { 0xCA, 0x02, layer });
+			put( { 0xC6, 0x32, layer });
+			put(uniform(0, 16383), 2);
+		}
+	}
+	put( { 0xD7 });
+
+	for (uint8_t& b : job)
+		b = scramble(b);
+	FILE* file = fopen(argv[2], "wb");
+	if (file == NULL || fwrite(job.data(), 1, job.size(), file) != job.size() || fclose(file) != 0) {
+		perror(argv[2]);
+		return 1;
+	}
+	return 0;
+}
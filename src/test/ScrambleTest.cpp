@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../Scramble.hpp"
+
+// the bulk kernels against descrambleScalar(), on random buffers of every length up to a few
+// vectors and at every alignment of a vector, in place and out of place
+typedef void (*DescrambleKernel)(const uint8_t*, uint8_t*, size_t);
+
+static int failures = 0;
+
+static void checkKernel(const char* name, DescrambleKernel kernel) {
+	static constexpr size_t MAX_LEN = 3 * 32 + 31;
+	static constexpr size_t MAX_SHIFT = 32;
+	std::mt19937 random(42);
+	std::vector<uint8_t> src(MAX_LEN + MAX_SHIFT), expected(MAX_LEN), dst(MAX_LEN + MAX_SHIFT + 1);
+	for (size_t len = 0; len <= MAX_LEN; ++len) {
+		for (size_t shift = 0; shift < MAX_SHIFT; ++shift) {
+			for (uint8_t& b : src)
+				b = random();
+			descrambleScalar(src.data() + shift, expected.data(), len);
+
+			// the byte behind the buffer must stay untouched
+			std::fill(dst.begin(), dst.end(), 0xA5);
+			kernel(src.data() + shift, dst.data() + (MAX_SHIFT - 1 - shift), len);
+			if (memcmp(dst.data() + (MAX_SHIFT - 1 - shift), expected.data(), len) != 0
+					|| dst[MAX_SHIFT - 1 - shift + len] != 0xA5) {
+				printf("FAIL %s: length %zu, offset %zu\n", name, len, shift);
+				++failures;
+				return;
+			}
+
+			kernel(src.data() + shift, src.data() + shift, len);
+			if (memcmp(src.data() + shift, expected.data(), len) != 0) {
+				printf("FAIL %s in place: length %zu, offset %zu\n", name, len, shift);
+				++failures;
+				return;
+			}
+		}
+	}
+	printf("ok %s\n", name);
+}
+
+int main() {
+	// the reference against the byte function, for every byte
+	for (int i = 0; i < 256; ++i) {
+		uint8_t s = i, d;
+		descrambleScalar(&s, &d, 1);
+		if (d != descramble(s)) {
+			printf("FAIL scalar: byte %02x\n", i);
+			++failures;
+		}
+	}
+
+	checkKernel("lut", descrambleLut);
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		checkKernel("sse2", descrambleSse2);
+	if (__builtin_cpu_supports("avx2"))
+		checkKernel("avx2", descrambleAvx2);
+#endif
+	checkKernel("dispatch", descramble);
+	return failures == 0 ? 0 : 1;
+}